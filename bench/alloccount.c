@@ -0,0 +1,68 @@
+/*
+  alloccount - count a program's heap allocations
+
+  usage:
+
+    LD_PRELOAD=bench/alloccount.so program ...
+
+  the library stands in for malloc, calloc, realloc, posix_memalign,
+  aligned_alloc and memalign, counting each call before passing it on
+  to the C library. a program reads the count by calling
+
+    long long alloc_count(void);
+
+  declared weak, so that the call is only made when the library is
+  loaded: the dispatcher does this with --stats to report the
+  allocations its ticks make.
+*/
+#include <stddef.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static long long count;
+
+long long alloc_count(void) {
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+}
+
+static void counted(void) {
+    __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    counted();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    counted();
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    counted();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    counted();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    counted();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    counted();
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return 12; // ENOMEM
+    }
+    *ptr = p;
+    return 0;
+}
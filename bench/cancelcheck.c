@@ -0,0 +1,186 @@
+/*
+  cancelcheck - cancel jobs in each state a dispatcher can hold them in
+
+  usage:
+
+    cancelcheck [-P] dispatcher
+
+  the program starts [dispatcher] on a control socket of its own, with
+  --pipelined if -P is given, and cancels over the socket:
+
+    a system job's queued, never started neighbour  0,0,4 and 0,1,2
+    the running system job                          then job 0
+    a suspended job, with another one running       0,3,3 and 0,3,3
+
+  checking each time that the cancel is acknowledged and that the
+  dispatcher still answers a query within TIMEOUT_S. it then shuts the
+  dispatcher down, checks that a submission after that is refused, and
+  that the dispatcher exits, with status 0, once the last job has run.
+  it exits 1 at the first check that fails.
+*/
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define TIMEOUT_S 5
+#define EXIT_TIMEOUT_S 15
+#define REPLY_SIZE 4096
+
+static char socket_path[64];
+static pid_t dispatcher;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Stops the dispatcher, if it is still there, and exits 1.
+
+static void fail(const char *what, const char *reply) {
+    fprintf(stderr, "cancelcheck: %s%s%s", what, reply ? ": " : "\n", reply ? reply : "");
+    kill(dispatcher, SIGKILL);
+    waitpid(dispatcher, 0, 0);
+    unlink(socket_path);
+    exit(1);
+}
+
+// Sends one command on a new connection and reads the reply into reply,
+// failing if there is none within TIMEOUT_S.
+
+static void command(const char *cmd, char *reply) {
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fail("can't connect to the dispatcher", strerror(errno));
+    }
+    struct timeval tv = { TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    size_t len = strlen(cmd);
+    if (write(fd, cmd, len) != (ssize_t)len) {
+        fail("can't send", cmd);
+    }
+    len = 0;
+    while (len == 0 || reply[len - 1] != '\n') {
+        ssize_t n = read(fd, reply + len, REPLY_SIZE - 1 - len);
+        if (n <= 0) {
+            reply[len] = '\0';
+            fail("no reply to", cmd);
+        }
+        len += n;
+    }
+    reply[len] = '\0';
+    close(fd);
+}
+
+// Queries the dispatcher until the reply contains want, failing if it
+// hasn't within TIMEOUT_S.
+
+static void wait_for(const char *want) {
+    char reply[REPLY_SIZE];
+    double give_up = now_s() + TIMEOUT_S;
+    for (;;) {
+        command("query\n", reply);
+        if (strstr(reply, want)) {
+            return;
+        }
+        if (now_s() > give_up) {
+            fail(want, reply);
+        }
+        usleep(50000);
+    }
+}
+
+// Cancels a job, checking the reply and that the dispatcher still answers.
+
+static void cancel(int id) {
+    char cmd[32], want[32], reply[REPLY_SIZE];
+    snprintf(cmd, sizeof(cmd), "cancel %d\n", id);
+    snprintf(want, sizeof(want), "cancel %d ok\n", id);
+    command(cmd, reply);
+    if (strcmp(reply, want) != 0) {
+        fail(cmd, reply);
+    }
+    command("query\n", reply);
+    printf("cancel %d ok, then %s", id, reply);
+}
+
+int main(int argc, char **argv) {
+    int pipelined = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "P")) != -1) {
+        switch (opt) {
+        case 'P':
+            pipelined = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-P] dispatcher\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-P] dispatcher\n", argv[0]);
+        return 1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "/tmp/cancelcheck.%d", (int)getpid());
+    unlink(socket_path);
+    dispatcher = fork();
+    if (dispatcher == 0) {
+        // in a group of its own, so that a signal it sends its group by
+        // mistake doesn't reach this program; the jobs' output is of no
+        // interest
+        setpgid(0, 0);
+        freopen("/dev/null", "w", stdout);
+        execl(argv[optind], argv[optind], "-u", socket_path, pipelined ? "-P" : (char *)0,
+              (char *)0);
+        perror("cancelcheck: exec");
+        _exit(127);
+    }
+    double give_up = now_s() + TIMEOUT_S;
+    while (access(socket_path, F_OK) < 0) {
+        if (now_s() > give_up || waitpid(dispatcher, 0, WNOHANG) != 0) {
+            fail("the dispatcher didn't open its socket", 0);
+        }
+        usleep(10000);
+    }
+
+    char reply[REPLY_SIZE];
+    command("submit +0,0,4\nsubmit +0,1,2\n", reply);
+    wait_for("run job 0 rq [] [1]");
+    cancel(1);
+    cancel(0);
+    command("submit +0,3,3\nsubmit +0,3,3\n", reply);
+    wait_for("run job 3 rq [] [] [] [2]");
+    cancel(2);
+    command("shutdown\n", reply);
+    command("submit +0,1,2\n", reply);
+    if (strcmp(reply, "error shutting down\n") != 0) {
+        fail("a submission after the shutdown wasn't refused", reply);
+    }
+
+    give_up = now_s() + EXIT_TIMEOUT_S;
+    int status;
+    while (waitpid(dispatcher, &status, WNOHANG) == 0) {
+        if (now_s() > give_up) {
+            fail("the dispatcher didn't exit after the shutdown", 0);
+        }
+        usleep(50000);
+    }
+    unlink(socket_path);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "cancelcheck: the dispatcher exited with status %d\n", status);
+        return 1;
+    }
+    printf("the dispatcher exited cleanly\n");
+    return 0;
+}
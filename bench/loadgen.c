@@ -0,0 +1,209 @@
+/*
+  loadgen - submit jobs to a dispatcher's control socket and time it
+
+  usage:
+
+    loadgen [-c clients] [-n jobs] [-b batch] [-a arrival] [-q] [-x] socket
+
+  each of [clients] (default 4) connections submits [jobs] (default
+  100000) jobs in batches of [batch] lines (default 100), waiting for
+  the dispatcher to acknowledge each batch before sending the next.
+  the program reports submissions per second and the round trip time
+  of a batch.
+
+  jobs are submitted as [arrival],priority,1 with priorities cycling
+  through 1 to 3. [arrival] defaults to +3600, an hour from now, so
+  that the benchmark measures admission rather than running the jobs.
+
+  -q  query the dispatcher's queues once every client has finished
+  -x  then shut the dispatcher down, cancelling jobs not yet arrived
+*/
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_CLIENTS 64
+#define LINE_SIZE 64
+#define REPLY_SIZE 65536
+
+typedef struct client_struct {
+    pthread_t thread;
+    int fd;
+    int batches;
+    double total_ms; // Round trip times of the batches
+    double max_ms;
+    long errors;
+} client;
+
+static const char *socket_path;
+static const char *arrival = "+3600";
+static int jobs = 100000;
+static int batch = 100;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int connect_socket(void) {
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "loadgen: can't connect to %s: %s\n", socket_path, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+// Reads from fd until a whole line has arrived and copies it into line.
+// Lines after it in the same read are not expected, as each client waits for
+// its reply before sending more.
+
+static void read_line(int fd, char *line, int size) {
+    int len = 0;
+    while (len == 0 || line[len - 1] != '\n') {
+        ssize_t n = read(fd, line + len, size - 1 - len);
+        if (n <= 0) {
+            fprintf(stderr, "loadgen: connection closed\n");
+            exit(1);
+        }
+        len += n;
+    }
+    line[len] = '\0';
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            perror("loadgen: write");
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void *run_client(void *arg) {
+    client *c = (client *)arg;
+    char *buf = malloc((size_t)batch * LINE_SIZE);
+    char reply[REPLY_SIZE];
+    int sent = 0;
+    while (sent < jobs) {
+        int n = jobs - sent < batch ? jobs - sent : batch;
+        size_t len = 0;
+        for (int i = 0; i < n; i++) {
+            len += snprintf(buf + len, LINE_SIZE, "submit %s,%d,1\n", arrival,
+                            (sent + i) % 3 + 1);
+        }
+        double start = now_ms();
+        write_all(c->fd, buf, len);
+        read_line(c->fd, reply, REPLY_SIZE);
+        double ms = now_ms() - start;
+        if (strncmp(reply, "ok ", 3) != 0) {
+            c->errors++;
+        }
+        c->batches++;
+        c->total_ms += ms;
+        if (ms > c->max_ms) {
+            c->max_ms = ms;
+        }
+        sent += n;
+    }
+    free(buf);
+    return 0;
+}
+
+// Sends one command on a new connection and prints the reply.
+
+static void command(const char *cmd) {
+    char reply[REPLY_SIZE];
+    int fd = connect_socket();
+    write_all(fd, cmd, strlen(cmd));
+    read_line(fd, reply, REPLY_SIZE);
+    printf("%s", reply);
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    int clients = 4, query = 0, shutdown = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:b:a:qx")) != -1) {
+        switch (opt) {
+        case 'c':
+            clients = atoi(optarg);
+            break;
+        case 'n':
+            jobs = atoi(optarg);
+            break;
+        case 'b':
+            batch = atoi(optarg);
+            break;
+        case 'a':
+            arrival = optarg;
+            break;
+        case 'q':
+            query = 1;
+            break;
+        case 'x':
+            shutdown = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c clients] [-n jobs] [-b batch] [-a arrival] [-q] [-x] "
+                    "socket\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || clients < 1 || clients > MAX_CLIENTS || jobs < 0 || batch < 1) {
+        fprintf(stderr, "usage: %s [-c clients] [-n jobs] [-b batch] [-a arrival] [-q] [-x] "
+                "socket\n", argv[0]);
+        return 1;
+    }
+    socket_path = argv[optind];
+
+    client cs[MAX_CLIENTS];
+    memset(cs, 0, sizeof(cs));
+    for (int i = 0; i < clients; i++) {
+        cs[i].fd = connect_socket();
+    }
+    double start = now_ms();
+    for (int i = 0; i < clients; i++) {
+        pthread_create(&cs[i].thread, 0, run_client, &cs[i]);
+    }
+    int batches = 0;
+    long errors = 0;
+    double total_ms = 0, max_ms = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(cs[i].thread, 0);
+        close(cs[i].fd);
+        batches += cs[i].batches;
+        errors += cs[i].errors;
+        total_ms += cs[i].total_ms;
+        if (cs[i].max_ms > max_ms) {
+            max_ms = cs[i].max_ms;
+        }
+    }
+    double elapsed = now_ms() - start;
+    long total = (long)clients * jobs;
+    printf("%ld jobs from %d clients in %.3f s: %.0f submissions/s\n", total, clients,
+           elapsed / 1e3, elapsed > 0 ? total / (elapsed / 1e3) : 0.0);
+    printf("%d batches of up to %d: round trip mean %.3f ms, max %.3f ms, %ld errors\n",
+           batches, batch, batches ? total_ms / batches : 0.0, max_ms, errors);
+    if (query) {
+        command("query\n");
+    }
+    if (shutdown) {
+        command("shutdown\n");
+    }
+    return 0;
+}
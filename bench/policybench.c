@@ -0,0 +1,311 @@
+/*
+  policybench - compare the dispatcher's scheduling policies on one list
+
+  usage:
+
+    policybench [-d dispatcher] [-r reps] [-g jobs] [-k lists] [-s seed]
+                [-m policy,...] [-c] [-a alloccount.so] [list]
+
+  the program runs the dispatcher (default ./dispatcher) with
+  --simulate --stats under each policy (default mlfq,rr,fcfs) on the
+  same dispatch list, [reps] times each (default 3), and prints a table
+  of what the reports say: the dispatcher's cpu time per tick, the
+  best wall time of a run, context switches, mean turnaround and
+  response over all jobs, and the arrival-to-start latency of system
+  jobs.
+
+  without a list, [lists] lists (default 1) of [jobs] jobs (default
+  100000) are generated, from seed [seed] (default 1) up: arrivals
+  spread at random over a little more than the total service time, so
+  the CPU is about 90% busy, one job in six a system job, service times
+  of 1 to 8 ticks.
+
+  -c  also trace each run and check that every policy made the same
+      decisions as the first, the queues aside. -m srtf,srtf-scan checks
+      the heap version of a policy against its brute-force reference.
+  -a  run the dispatcher with the allocation counter preloaded, count
+      the heap allocations its ticks made, and fail if any did. on a
+      generated list the queues stay well short of their reserve, so
+      every tick after loading should allocate nothing.
+*/
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define DEFAULT_REPS 3
+#define DEFAULT_JOBS 100000
+#define MAX_POLICIES 16
+#define LINE_SIZE 8192
+
+typedef struct result_struct {
+    double wall_ms; // Best over the repetitions
+    double tick_ns; // Dispatcher cpu per tick, from the same run
+    int switches;
+    double turnaround_s, response_s;
+    double sys_mean_ms, sys_max_ms;
+    long long tick_allocs; // Heap allocations made by the ticks, with -a
+} result;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Writes a list of n jobs generated from seed to path.
+
+static void generate_list(const char *path, int n, int seed) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    srand(seed);
+    double span = n * 4.5 / 0.9; // mean service is 4.5 ticks
+    int i;
+    for (i = 0; i < n; i++) {
+        fprintf(fp, "%.3f,%d,%d\n", span * rand() / RAND_MAX, rand() % 6 == 0 ? 0 : 1 + rand() % 3,
+                1 + rand() % 8);
+    }
+    fclose(fp);
+}
+
+// Runs the dispatcher once under policy, tracing to trace unless it is 0,
+// and fills in r from its report. Returns 0, or -1 if it failed.
+
+static const char *alloc_lib; // The allocation counter to preload, with -a
+
+static int run_once(const char *dispatcher, const char *policy, const char *list,
+                    const char *trace, result *r) {
+    int report[2];
+    if (pipe(report) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(report[1], STDERR_FILENO);
+        close(report[0]);
+        if (alloc_lib) {
+            setenv("LD_PRELOAD", alloc_lib, 1);
+        }
+        if (trace) {
+            execl(dispatcher, dispatcher, "--simulate", "--stats", "--policy", policy,
+                  "--trace", trace, list, (char *)0);
+        } else {
+            execl(dispatcher, dispatcher, "--simulate", "--stats", "--policy", policy, list,
+                  (char *)0);
+        }
+        perror(dispatcher);
+        _exit(127);
+    }
+    close(report[1]);
+    FILE *fp = fdopen(report[0], "r");
+    char line[LINE_SIZE];
+    double cpu_s;
+    long long startup_allocs;
+    int ticks, done, alloc_ticks;
+    memset(r, 0, sizeof(result));
+    while (fgets(line, LINE_SIZE, fp)) {
+        sscanf(line, "arrival-to-start latency: mean %lf ms, max %lf ms", &r->sys_mean_ms,
+               &r->sys_max_ms);
+        sscanf(line, "processes run: %d, mean turnaround %lf s, mean response %lf s", &done,
+               &r->turnaround_s, &r->response_s);
+        sscanf(line, "dispatcher cpu: %lf s over %d ticks, %lf ns per tick", &cpu_s, &ticks,
+               &r->tick_ns);
+        sscanf(line, "context switches: %d", &r->switches);
+        sscanf(line, "heap allocations: %lld before tick 0, %lld in %d ticks", &startup_allocs,
+               &r->tick_allocs, &alloc_ticks);
+    }
+    fclose(fp);
+    int status;
+    waitpid(pid, &status, 0);
+    r->wall_ms = now_ms() - start;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// Reads the next record of a trace into line, less the run queues of a tick
+// record, as policies keep their queues in different orders. Returns 0 at
+// the end of the trace.
+
+static int next_decision(FILE *fp, char *line) {
+    if (!fgets(line, LINE_SIZE, fp)) {
+        return 0;
+    }
+    char *rq = strstr(line, " rq ");
+    if (rq) {
+        strcpy(rq, "\n");
+    }
+    return 1;
+}
+
+// Compares two traces decision by decision. Returns the number of the first
+// record that differs, or 0 if they are the same.
+
+static int compare_traces(const char *a, const char *b) {
+    FILE *fa = fopen(a, "r"), *fb = fopen(b, "r");
+    if (!fa || !fb) {
+        perror("fopen");
+        exit(1);
+    }
+    char la[LINE_SIZE], lb[LINE_SIZE];
+    int n = 0, differs = 0;
+    for (;;) {
+        int ga = next_decision(fa, la), gb = next_decision(fb, lb);
+        n++;
+        if (ga != gb || (ga && strcmp(la, lb) != 0)) {
+            differs = n;
+            break;
+        }
+        if (!ga) {
+            break;
+        }
+    }
+    fclose(fa);
+    fclose(fb);
+    return differs;
+}
+
+int main(int argc, char **argv) {
+    const char *dispatcher = "./dispatcher";
+    const char *policy_list = "mlfq,rr,fcfs";
+    int reps = DEFAULT_REPS, jobs = DEFAULT_JOBS, lists = 1, seed = 1, check = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:r:g:k:s:m:ca:")) != -1) {
+        switch (opt) {
+        case 'd':
+            dispatcher = optarg;
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'g':
+            jobs = atoi(optarg);
+            break;
+        case 'k':
+            lists = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'm':
+            policy_list = optarg;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'a':
+            alloc_lib = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d dispatcher] [-r reps] [-g jobs] [-k lists] [-s seed] "
+                    "[-m policy,...] [-c] [-a alloccount.so] [list]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc - 1 || reps < 1 || jobs < 1 || lists < 1) {
+        fprintf(stderr, "usage: %s [-d dispatcher] [-r reps] [-g jobs] [-k lists] [-s seed] "
+                "[-m policy,...] [-c] [-a alloccount.so] [list]\n", argv[0]);
+        return 1;
+    }
+    if (optind < argc) {
+        lists = 1;
+    }
+
+    char *policies[MAX_POLICIES];
+    int n = 0;
+    char *s;
+    for (s = strtok(strdup(policy_list), ","); s && n < MAX_POLICIES; s = strtok(0, ",")) {
+        policies[n++] = s;
+    }
+
+    char dir[] = "/tmp/policybench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char list[64], traces[MAX_POLICIES][64];
+    int i, j, k, status = 0, mismatches = 0, allocating = 0;
+    for (i = 0; i < n; i++) {
+        snprintf(traces[i], sizeof(traces[i]), "%s/trace.%d", dir, i);
+    }
+
+    printf("%-6s %-14s %10s %10s %10s %12s %12s %12s %12s%s%s\n", "seed", "policy", "ns/tick",
+           "wall ms", "switches", "turnaround s", "response s", "sys mean ms", "sys max ms",
+           alloc_lib ? "  tick allocs" : "", check ? "  schedule" : "");
+    for (k = 0; k < lists; k++) {
+        const char *path = list;
+        if (optind < argc) {
+            path = argv[optind];
+        } else {
+            snprintf(list, sizeof(list), "%s/list", dir);
+            generate_list(list, jobs, seed + k);
+        }
+        for (i = 0; i < n; i++) {
+            result best = { 0 }, r;
+            for (j = 0; j < reps; j++) {
+                // the trace would be the same every time, and slows the runs
+                const char *trace = check && j == 0 ? traces[i] : 0;
+                if (run_once(dispatcher, policies[i], path, trace, &r) < 0) {
+                    fprintf(stderr, "%s failed under %s\n", dispatcher, policies[i]);
+                    status = 1;
+                    break;
+                }
+                if (j == 0 || r.wall_ms < best.wall_ms) {
+                    best = r;
+                }
+            }
+            if (j < reps) {
+                continue;
+            }
+            char seed_text[16] = "-", schedule[32] = "", allocs[32] = "";
+            if (optind == argc) {
+                snprintf(seed_text, sizeof(seed_text), "%d", seed + k);
+            }
+            if (alloc_lib) {
+                snprintf(allocs, sizeof(allocs), "  %11lld", best.tick_allocs);
+                allocating += best.tick_allocs > 0;
+            }
+            if (check) {
+                int differs = i ? compare_traces(traces[0], traces[i]) : 0;
+                if (differs) {
+                    snprintf(schedule, sizeof(schedule), "  differs at record %d", differs);
+                    mismatches++;
+                } else {
+                    snprintf(schedule, sizeof(schedule), i ? "  same" : "  reference");
+                }
+            }
+            printf("%-6s %-14s %10.0f %10.1f %10d %12.3f %12.3f %12.3f %12.3f%s%s\n", seed_text,
+                   policies[i], best.tick_ns, best.wall_ms, best.switches, best.turnaround_s,
+                   best.response_s, best.sys_mean_ms, best.sys_max_ms, allocs, schedule);
+            fflush(stdout);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        unlink(traces[i]);
+    }
+    if (optind == argc) {
+        unlink(list);
+    }
+    rmdir(dir);
+    if (check && mismatches) {
+        fprintf(stderr, "%d schedules differ from the first policy's\n", mismatches);
+        status = 1;
+    }
+    if (allocating) {
+        fprintf(stderr, "%d runs allocated on the heap in their ticks\n", allocating);
+        status = 1;
+    }
+    return status;
+}
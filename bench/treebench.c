@@ -0,0 +1,234 @@
+/*
+  treebench - time suspending, resuming and terminating a whole job tree
+
+  usage:
+
+    treebench [-c cgroup_dir] [-r reps] [size ...]
+
+  for each size (default 1 10 100 1000) the program starts that many
+  processes in one process group, as the dispatcher does for a job and
+  the helpers it forks, and times each operation three ways:
+
+    pgroup   one kill() on the process group
+    per-pid  one kill() per process, the cost without process groups
+    cgroup   one write to cgroup.freeze / cgroup.kill (with -c only)
+
+  an operation is timed until every process has been seen to stop,
+  continue or exit. all processes are direct children of the benchmark
+  (flat tree) so that each of them can be waited for.
+*/
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "cgroup.h"
+
+#define DEFAULT_REPS 5
+#define MAX_SIZES 16
+
+enum method { pgroup, per_pid, cgroup, num_methods };
+enum op { suspend, resume, terminate, num_ops };
+
+typedef struct tree_struct {
+    int n;
+    pid_t *pids; // pids[0] is the process group leader
+    CGROUP *cg;
+} tree;
+
+static const char *op_names[] = { "suspend", "resume", "terminate" };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Starts n processes in a new process group (and cgroup, if cg is set) and
+// waits until all of them are in place.
+
+static tree *spawn_tree(int n, CGROUP *cg) {
+    tree *t = malloc(sizeof(tree));
+    t->n = n;
+    t->pids = malloc(sizeof(pid_t) * n);
+    t->cg = cg;
+    int ready[2];
+    if (pipe(ready) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            setpgid(0, i == 0 ? 0 : t->pids[0]);
+            if (cg) {
+                joinCGROUP(cg);
+            }
+            close(ready[0]);
+            if (write(ready[1], "", 1) < 0) {
+                _exit(1);
+            }
+            close(ready[1]);
+            for (;;) {
+                pause();
+            }
+        }
+        setpgid(pid, i == 0 ? pid : t->pids[0]);
+        t->pids[i] = pid;
+    }
+    close(ready[1]);
+    char c;
+    for (int i = 0; i < n; i++) {
+        if (read(ready[0], &c, 1) != 1) {
+            fprintf(stderr, "treebench: child failed to start\n");
+            exit(1);
+        }
+    }
+    close(ready[0]);
+    return t;
+}
+
+// Collects one status change of the given kind from every process in t.
+
+static void wait_tree(tree *t, int options) {
+    for (int i = 0; i < t->n; i++) {
+        if (waitpid(-t->pids[0], NULL, options) < 0) {
+            perror("waitpid");
+            exit(1);
+        }
+    }
+}
+
+static void signal_tree(tree *t, enum method m, int sig) {
+    if (m == pgroup) {
+        kill(-t->pids[0], sig);
+    } else {
+        for (int i = 0; i < t->n; i++) {
+            kill(t->pids[i], sig);
+        }
+    }
+}
+
+// Returns the time in milliseconds that op takes on t using method m.
+
+static double time_op(tree *t, enum method m, enum op op) {
+    double start = now_ms();
+    switch (op) {
+    case suspend:
+        if (m == cgroup) {
+            freezeCGROUP(t->cg);
+            frozenCGROUP(t->cg, -1);
+        } else {
+            signal_tree(t, m, SIGTSTP);
+            wait_tree(t, WUNTRACED);
+        }
+        break;
+    case resume:
+        if (m == cgroup) {
+            thawCGROUP(t->cg);
+            while (frozenCGROUP(t->cg, 0)) {
+            }
+        } else {
+            signal_tree(t, m, SIGCONT);
+            wait_tree(t, WCONTINUED);
+        }
+        break;
+    case terminate:
+        if (m == cgroup) {
+            killCGROUP(t->cg);
+        } else {
+            signal_tree(t, m, SIGINT);
+        }
+        wait_tree(t, 0);
+        break;
+    default:
+        break;
+    }
+    return now_ms() - start;
+}
+
+static void free_tree(tree *t) {
+    free(t->pids);
+    free(t);
+}
+
+int main(int argc, char **argv) {
+    char *cgroup_dir = 0;
+    int reps = DEFAULT_REPS;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:")) != -1) {
+        switch (opt) {
+        case 'c':
+            cgroup_dir = optarg;
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c cgroup_dir] [-r reps] [size ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    int sizes[MAX_SIZES] = { 1, 10, 100, 1000 };
+    int num_sizes = 4;
+    if (optind < argc) {
+        for (num_sizes = 0; optind < argc && num_sizes < MAX_SIZES; num_sizes++) {
+            sizes[num_sizes] = atoi(argv[optind++]);
+        }
+    }
+    if (reps <= 0) {
+        reps = 1;
+    }
+
+    CGROUP *cg = 0;
+    if (cgroup_dir) {
+        char name[32];
+        snprintf(name, sizeof(name), "treebench.%d", (int)getpid());
+        cg = newCGROUP(cgroup_dir, name);
+        if (!cg) {
+            fprintf(stderr, "treebench: can't use cgroup under %s: %s\n", cgroup_dir,
+                    strerror(errno));
+            return 1;
+        }
+    }
+    int num_methods_used = cg ? num_methods : cgroup;
+
+    printf("%6s  %-9s  %10s  %10s", "procs", "op", "pgroup ms", "per-pid ms");
+    if (cg) {
+        printf("  %10s", "cgroup ms");
+    }
+    printf("\n");
+    for (int s = 0; s < num_sizes; s++) {
+        int n = sizes[s];
+        double total[num_ops][num_methods];
+        memset(total, 0, sizeof(total));
+        for (int r = 0; r < reps; r++) {
+            for (int m = 0; m < num_methods_used; m++) {
+                tree *t = spawn_tree(n, m == cgroup ? cg : 0);
+                for (int op = 0; op < num_ops; op++) {
+                    total[op][m] += time_op(t, m, op);
+                }
+                free_tree(t);
+            }
+        }
+        for (int op = 0; op < num_ops; op++) {
+            printf("%6d  %-9s", n, op_names[op]);
+            for (int m = 0; m < num_methods_used; m++) {
+                printf("  %10.3f", total[op][m] / reps);
+            }
+            printf("\n");
+        }
+    }
+    if (cg) {
+        freeCGROUP(cg);
+    }
+    return 0;
+}
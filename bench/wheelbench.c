@@ -0,0 +1,215 @@
+/*
+  wheelbench - time the timing wheel against a binary heap
+
+  usage:
+
+    wheelbench [-n timers] [-s span_us] [-c cancel%] [-t step_us] [-r seed]
+
+  the program adds [timers] timers (default 1000000) due at random times
+  over [span_us] microseconds (default 60000000, a minute), cancels
+  [cancel%] of them (default 25), and then expires the rest by moving the
+  time on [step_us] at a time (default 1000), first with the wheel and
+  then with a binary heap on due time, the way the dispatcher kept its
+  arrivals before. It checks that both expire the same timers at the
+  same steps and prints the cost per operation of each phase.
+*/
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "wheel.h"
+
+#define DEFAULT_TIMERS 1000000
+#define DEFAULT_SPAN_US 60000000
+#define DEFAULT_CANCEL 25
+#define DEFAULT_STEP_US 1000
+
+typedef struct entry_struct {
+    TIMER timer;
+    int heap_index; // Where it is in the heap, or -1
+    int64_t fired_at; // The step it expired at, by each structure
+    int64_t heap_fired_at;
+} entry;
+
+static entry **heap;
+static int heap_size;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void heap_set(int i, entry *e) {
+    heap[i] = e;
+    e->heap_index = i;
+}
+
+static void sift_up(int i, entry *e) {
+    while (i > 0 && heap[(i - 1) / 2]->timer.when > e->timer.when) {
+        heap_set(i, heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(i, e);
+}
+
+static void sift_down(int i, entry *e) {
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= heap_size) {
+            break;
+        }
+        if (c + 1 < heap_size && heap[c + 1]->timer.when < heap[c]->timer.when) {
+            c++;
+        }
+        if (heap[c]->timer.when >= e->timer.when) {
+            break;
+        }
+        heap_set(i, heap[c]);
+        i = c;
+    }
+    heap_set(i, e);
+}
+
+static void heap_push(entry *e) {
+    sift_up(heap_size++, e);
+}
+
+static void heap_remove(entry *e) {
+    int i = e->heap_index;
+    entry *last = heap[--heap_size];
+    e->heap_index = -1;
+    if (i == heap_size) {
+        return;
+    }
+    if (i > 0 && heap[(i - 1) / 2]->timer.when > last->timer.when) {
+        sift_up(i, last);
+    } else {
+        sift_down(i, last);
+    }
+}
+
+int main(int argc, char **argv) {
+    int n = DEFAULT_TIMERS, cancel = DEFAULT_CANCEL, seed = 1;
+    int64_t span = DEFAULT_SPAN_US, step = DEFAULT_STEP_US;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:c:t:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 's':
+            span = atoll(optarg);
+            break;
+        case 'c':
+            cancel = atoi(optarg);
+            break;
+        case 't':
+            step = atoll(optarg);
+            break;
+        case 'r':
+            seed = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n timers] [-s span_us] [-c cancel%%] [-t step_us] "
+                    "[-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n < 1 || span < 1 || step < 1 || cancel < 0 || cancel > 100) {
+        fprintf(stderr, "usage: %s [-n timers] [-s span_us] [-c cancel%%] [-t step_us] "
+                "[-r seed]\n", argv[0]);
+        return 1;
+    }
+
+    entry *entries = (entry *)malloc(n * sizeof(entry));
+    int64_t *whens = (int64_t *)malloc(n * sizeof(int64_t));
+    char *cancelled = (char *)malloc(n);
+    heap = (entry **)malloc(n * sizeof(entry *));
+    if (!entries || !whens || !cancelled || !heap) {
+        perror("malloc");
+        return 1;
+    }
+    srand(seed);
+    int i, fired = 0, heap_fired = 0, cancels = 0;
+    for (i = 0; i < n; i++) {
+        whens[i] = ((int64_t)rand() * RAND_MAX + rand()) % span;
+        cancelled[i] = rand() % 100 < cancel;
+        cancels += cancelled[i];
+        initTIMER(&entries[i].timer, &entries[i]);
+        entries[i].fired_at = entries[i].heap_fired_at = -1;
+    }
+
+    // the wheel
+    WHEEL *w = newWHEEL(0);
+    double t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        addWHEEL(w, &entries[i].timer, whens[i]);
+    }
+    double t1 = now_ns();
+    for (i = 0; i < n; i++) {
+        if (cancelled[i]) {
+            cancelWHEEL(w, &entries[i].timer);
+        }
+    }
+    double t2 = now_ns();
+    int64_t t;
+    for (t = 0; t < span + step; t += step) {
+        TIMER *timer;
+        for (timer = expireWHEEL(w, t); timer; timer = timer->next) {
+            ((entry *)timer->data)->fired_at = t;
+            fired++;
+        }
+    }
+    double t3 = now_ns();
+    double wheel_add = (t1 - t0) / n, wheel_cancel = cancels ? (t2 - t1) / cancels : 0,
+           wheel_expire = fired ? (t3 - t2) / fired : 0;
+    int left = sizeWHEEL(w);
+    freeWHEEL(w);
+
+    // the heap, on the same times
+    for (i = 0; i < n; i++) {
+        entries[i].timer.when = whens[i];
+    }
+    t0 = now_ns();
+    for (i = 0; i < n; i++) {
+        heap_push(&entries[i]);
+    }
+    t1 = now_ns();
+    for (i = 0; i < n; i++) {
+        if (cancelled[i]) {
+            heap_remove(&entries[i]);
+        }
+    }
+    t2 = now_ns();
+    for (t = 0; t < span + step; t += step) {
+        while (heap_size > 0 && heap[0]->timer.when <= t) {
+            entry *e = heap[0];
+            heap_remove(e);
+            e->heap_fired_at = t;
+            heap_fired++;
+        }
+    }
+    t3 = now_ns();
+    double heap_add = (t1 - t0) / n, heap_cancel = cancels ? (t2 - t1) / cancels : 0,
+           heap_expire = heap_fired ? (t3 - t2) / heap_fired : 0;
+
+    int wrong = left != 0 || fired != heap_fired;
+    for (i = 0; i < n; i++) {
+        if (entries[i].fired_at != entries[i].heap_fired_at) {
+            wrong++;
+        }
+    }
+
+    printf("%d timers over %.3f s, %d cancelled, expired in steps of %lld us\n", n, span / 1e6,
+           cancels, (long long)step);
+    printf("%-6s %12s %12s %12s\n", "", "add ns", "cancel ns", "expire ns");
+    printf("%-6s %12.1f %12.1f %12.1f\n", "wheel", wheel_add, wheel_cancel, wheel_expire);
+    printf("%-6s %12.1f %12.1f %12.1f\n", "heap", heap_add, heap_cancel, heap_expire);
+    if (wrong) {
+        fprintf(stderr, "the wheel and the heap disagree on %d timers\n", wrong);
+        return 1;
+    }
+    return 0;
+}
@@ -9,6 +9,7 @@ struct cda {
                // back; we can compute it with the front and the size.
     void **arr;
     void (*display)(FILE *, void *);
+    int reserved; // Set by reserveCDA: the array grows but never shrinks
 };
 
 static void increaseCap(CDA *items);
@@ -27,6 +28,7 @@ CDA *newCDA(void (*d)(FILE *, void *)) {
     cda->arr = (void **)malloc(cda->cap * sizeof(void *));
     assert(cda->arr != 0);
     cda->display = d;
+    cda->reserved = 0;
     return cda;
 }
 
@@ -66,7 +68,7 @@ void insertCDAback(CDA *items, void *value) {
 
 void *removeCDAfront(CDA *items) {
     assert(items->size > 0);
-    if (items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
+    if (!items->reserved && items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
         reduceCap(items);
     }
     void *front = items->arr[items->front];
@@ -81,7 +83,7 @@ void *removeCDAfront(CDA *items) {
 
 void *removeCDAback(CDA *items) {
     assert(items->size > 0);
-    if (items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
+    if (!items->reserved && items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
         reduceCap(items);
     }
     int b = (items->front - 1 + items->size) % items->cap;
@@ -157,6 +159,19 @@ void **extractCDA(CDA *items) {
     return arr;
 }
 
+// Function: reserveCDA
+// Takes in a CDA object and a capacity
+// Grows the array to hold at least that many items, and stops it shrinking
+//     from then on, so that a CDA filled and emptied over and over stops
+//     allocating once it has grown to the most it holds.
+
+void reserveCDA(CDA *items, int cap) {
+    while (items->cap < cap) {
+        increaseCap(items);
+    }
+    items->reserved = 1;
+}
+
 // Function: sizeCDA
 // Takes in a CDA object
 // Returns the size of the CDA
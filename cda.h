@@ -23,6 +23,7 @@ extern void unionCDA(CDA *recipient,CDA *donor);
 extern void *getCDA(CDA *items,int index);
 extern void *setCDA(CDA *items,int index,void *value);
 extern void **extractCDA(CDA *items);
+extern void reserveCDA(CDA *items,int cap);
 extern int sizeCDA(CDA *items);
 extern void visualizeCDA(FILE *,CDA *items);
 extern void displayCDA(FILE *,CDA *items);
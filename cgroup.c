@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cgroup.h"
+
+#define PATH_SIZE 512
+#define FILE_PATH_SIZE (PATH_SIZE + 16) // Room for "/cgroup.events" etc.
+#define RMDIR_RETRIES 20
+
+struct cgroup {
+    char dir[PATH_SIZE];
+    char procs[FILE_PATH_SIZE]; // The control file paths are built up front
+    char freeze[FILE_PATH_SIZE]; // so joinCGROUP can run between fork and
+    char kill[FILE_PATH_SIZE]; // exec without allocating.
+    char cpu[FILE_PATH_SIZE];
+    int events; // cgroup.events, polled for changes of the frozen state
+};
+
+static int writeFile(const char *path, const char *value);
+static int readFrozen(int fd);
+
+// Function: newCGROUP
+// Takes in the path of a delegated cgroup v2 directory and a name.
+// Creates the cgroup parent/name, or reuses it if it already exists.
+// Returns the new CGROUP, or NULL (with errno set) if the cgroup can't be
+//     created or has no freezer, e.g. because parent is not cgroup v2.
+
+CGROUP *newCGROUP(const char *parent, const char *name) {
+    CGROUP *cg = (CGROUP *)malloc(sizeof(CGROUP));
+    assert(cg != 0);
+    if (snprintf(cg->dir, PATH_SIZE, "%s/%s", parent, name) >= PATH_SIZE) {
+        free(cg);
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    snprintf(cg->procs, FILE_PATH_SIZE, "%s/cgroup.procs", cg->dir);
+    snprintf(cg->freeze, FILE_PATH_SIZE, "%s/cgroup.freeze", cg->dir);
+    snprintf(cg->kill, FILE_PATH_SIZE, "%s/cgroup.kill", cg->dir);
+    snprintf(cg->cpu, FILE_PATH_SIZE, "%s/cpu.stat", cg->dir);
+    if (mkdir(cg->dir, 0755) < 0 && errno != EEXIST) {
+        free(cg);
+        return 0;
+    }
+    char events[FILE_PATH_SIZE];
+    snprintf(events, FILE_PATH_SIZE, "%s/cgroup.events", cg->dir);
+    cg->events = open(events, O_RDONLY | O_CLOEXEC);
+    if (cg->events < 0 || access(cg->freeze, W_OK) < 0) {
+        int saved = errno;
+        if (cg->events >= 0) {
+            close(cg->events);
+        }
+        rmdir(cg->dir);
+        free(cg);
+        errno = saved;
+        return 0;
+    }
+    return cg;
+}
+
+// Function: pathCGROUP
+// Takes in a CGROUP
+// Returns the path of its directory, for creating nested cgroups.
+
+const char *pathCGROUP(CGROUP *cg) {
+    return cg->dir;
+}
+
+// Function: joinCGROUP
+// Takes in a CGROUP
+// Moves the calling process into the cgroup; its future children are born
+//     there. Async-signal-safe, so a child can call it before exec.
+// Returns 0, or -1 with errno set.
+
+int joinCGROUP(CGROUP *cg) {
+    return writeFile(cg->procs, "0");
+}
+
+// Function: freezeCGROUP
+// Takes in a CGROUP
+// Asks the kernel to freeze every process in the cgroup. The freeze is
+//     asynchronous; frozenCGROUP reports when it has taken effect.
+// Returns 0, or -1 with errno set.
+
+int freezeCGROUP(CGROUP *cg) {
+    return writeFile(cg->freeze, "1");
+}
+
+// Function: thawCGROUP
+// Takes in a CGROUP
+// Lets the processes in a frozen cgroup run again.
+// Returns 0, or -1 with errno set.
+
+int thawCGROUP(CGROUP *cg) {
+    return writeFile(cg->freeze, "0");
+}
+
+// Function: frozenCGROUP
+// Takes in a CGROUP and a timeout in milliseconds; 0 doesn't wait and -1
+//     waits for as long as it takes.
+// Returns 1 if every process in the cgroup is frozen, 0 if they are not by
+//     the timeout, or -1 with errno set if cgroup.events can't be read.
+
+int frozenCGROUP(CGROUP *cg, int timeout_ms) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        int frozen = readFrozen(cg->events);
+        if (frozen != 0) {
+            return frozen;
+        }
+        int left = -1;
+        if (timeout_ms >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left = timeout_ms - ((now.tv_sec - start.tv_sec) * 1000
+                                 + (now.tv_nsec - start.tv_nsec) / 1000000);
+            if (left <= 0) {
+                return 0;
+            }
+        }
+        // cgroup.events raises POLLPRI whenever one of its values changes
+        struct pollfd pfd = { cg->events, POLLPRI, 0 };
+        if (poll(&pfd, 1, left) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Function: killCGROUP
+// Takes in a CGROUP
+// Sends SIGKILL to every process in the cgroup at once (Linux 5.14+).
+// Returns 0, or -1 with errno set if the kernel has no cgroup.kill.
+
+int killCGROUP(CGROUP *cg) {
+    return writeFile(cg->kill, "1");
+}
+
+// Function: cpuCGROUP
+// Takes in a CGROUP
+// Returns the CPU time in microseconds used so far by every process that has
+//     been in the cgroup, exited ones included, or -1 if it can't be read.
+
+long long cpuCGROUP(CGROUP *cg) {
+    int fd = open(cg->cpu, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    long long usage;
+    char *line = strstr(buf, "usage_usec ");
+    if (!line || sscanf(line, "usage_usec %lld", &usage) != 1) {
+        return -1;
+    }
+    return usage;
+}
+
+// Function: freeCGROUP
+// Takes in a CGROUP
+// Removes the cgroup directory, giving killed processes a few milliseconds
+//     to leave it, and frees the CGROUP either way.
+// Returns 0, or -1 with errno set if the directory couldn't be removed.
+
+int freeCGROUP(CGROUP *cg) {
+    int rc;
+    for (int i = 0; (rc = rmdir(cg->dir)) < 0 && errno == EBUSY && i < RMDIR_RETRIES; i++) {
+        usleep(1000);
+    }
+    int saved = errno;
+    close(cg->events);
+    free(cg);
+    errno = saved;
+    return rc;
+}
+
+// Static function: writeFile
+// Takes in the path of a cgroup control file and a value
+// Writes the value with plain system calls only.
+// Returns 0, or -1 with errno set.
+
+static int writeFile(const char *path, const char *value) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = strlen(value);
+    ssize_t n = write(fd, value, len);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n == len ? 0 : -1;
+}
+
+// Static function: readFrozen
+// Takes in the descriptor of a cgroup.events file
+// Returns 1 if it reports "frozen 1", 0 if "frozen 0", and -1 with errno
+//     set on error.
+
+static int readFrozen(int fd) {
+    char buf[256];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    char *frozen = strstr(buf, "frozen ");
+    if (!frozen) {
+        errno = EINVAL;
+        return -1;
+    }
+    return frozen[7] == '1';
+}
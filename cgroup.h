@@ -0,0 +1,24 @@
+/****************************************************************\
+ * FILE: cgroup.h
+ * This is the header file for the cgroup v2 job container module.
+ * A CGROUP is a child of a delegated cgroup v2 directory; every
+ * process started inside it, however deep the tree, can be frozen,
+ * thawed or killed with a single write.
+\****************************************************************/
+
+#ifndef __CGROUP_INCLUDED__
+#define __CGROUP_INCLUDED__
+
+typedef struct cgroup CGROUP;
+
+extern CGROUP *newCGROUP(const char *parent,const char *name);
+extern const char *pathCGROUP(CGROUP *cg);
+extern int joinCGROUP(CGROUP *cg);
+extern int freezeCGROUP(CGROUP *cg);
+extern int thawCGROUP(CGROUP *cg);
+extern int frozenCGROUP(CGROUP *cg,int timeout_ms);
+extern int killCGROUP(CGROUP *cg);
+extern long long cpuCGROUP(CGROUP *cg);
+extern int freeCGROUP(CGROUP *cg);
+
+#endif
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "command.h"
+
+#define BLOCK_SIZE (64 * 1024) // Arena grows by blocks of at least this size
+#define MIN_TABLE 64
+#define PATH_SIZE 4096
+
+typedef struct block_struct {
+    struct block_struct *next;
+    size_t used, size;
+    char data[];
+} BLOCK;
+
+struct commands {
+    BLOCK *blocks; // The one being filled first
+    size_t bytes; // Handed out over all blocks
+    COMMAND **table; // Open addressing on the text's hash
+    int capacity; // A power of two
+    int count;
+    char **environment; // Copied into the arena by sealCOMMANDS, or NULL
+    int envn;
+};
+
+static void *arenaAlloc(COMMANDS *c,size_t size);
+static char *arenaString(COMMANDS *c,const char *s,size_t len);
+static int normalize(const char *line,char *key);
+static uint64_t hash(const char *s);
+static void insertTable(COMMANDS *c,COMMAND *cmd);
+static int isAssignment(const char *word);
+static const char *findPath(COMMANDS *c,const char *name);
+static void buildEnvp(COMMANDS *c,COMMAND *cmd);
+
+// Function: newCOMMANDS
+// Takes in nothing
+// Returns a new, empty COMMANDS table.
+
+COMMANDS *newCOMMANDS(void) {
+    COMMANDS *c = (COMMANDS *)calloc(1, sizeof(COMMANDS));
+    assert(c != 0);
+    c->capacity = MIN_TABLE;
+    c->table = (COMMAND **)calloc(c->capacity, sizeof(COMMAND *));
+    assert(c->table != 0);
+    return c;
+}
+
+// Function: internCOMMANDS
+// Takes in a COMMANDS table and a command line, which may end in a newline
+// Splits the line and builds its COMMAND the first time it is seen; a line
+//     differing only in spacing is the same command. Its envp is built once
+//     the table is sealed.
+// Returns the COMMAND, which lives as long as the table, or NULL if the
+//     line names no program.
+
+const COMMAND *internCOMMANDS(COMMANDS *c, const char *line) {
+    char *key = (char *)malloc(strlen(line) + 1);
+    assert(key != 0);
+    if (normalize(line, key) == 0) {
+        free(key);
+        return 0;
+    }
+    uint64_t h = hash(key);
+    int mask = c->capacity - 1;
+    int i;
+    for (i = h & mask; c->table[i]; i = (i + 1) & mask) {
+        if (strcmp(c->table[i]->text, key) == 0) {
+            free(key);
+            return c->table[i];
+        }
+    }
+
+    // split a second copy of the text in place for argv and the assignments
+    size_t len = strlen(key);
+    int words = 1;
+    char *s;
+    for (s = key; *s; s++) {
+        words += *s == ' ';
+    }
+    COMMAND *cmd = (COMMAND *)arenaAlloc(c, sizeof(COMMAND));
+    cmd->text = arenaString(c, key, len);
+    char *split = arenaString(c, key, len);
+    free(key);
+    char **word = (char **)arenaAlloc(c, sizeof(char *) * (words + 1));
+    int n = 0;
+    for (s = split; s; n++) {
+        word[n] = s;
+        if ((s = strchr(s, ' '))) {
+            *s++ = '\0';
+        }
+    }
+    word[n] = 0;
+    cmd->envc = 0;
+    while (cmd->envc < n && isAssignment(word[cmd->envc])) {
+        cmd->envc++;
+    }
+    if (cmd->envc == n) {
+        // nothing to run; the arena space is simply not reused
+        return 0;
+    }
+    cmd->argv = word + cmd->envc;
+    cmd->argc = n - cmd->envc;
+    cmd->path = findPath(c, cmd->argv[0]);
+    cmd->envp = 0;
+    if (c->environment) {
+        buildEnvp(c, cmd);
+    }
+    insertTable(c, cmd);
+    return cmd;
+}
+
+// Function: sealCOMMANDS
+// Takes in a COMMANDS table and the environment every command should start
+//     with, normally environ once the caller has finished changing it
+// Copies the environment and builds the envp of each command interned so
+//     far; later commands get theirs as they are interned.
+// Returns nothing.
+
+void sealCOMMANDS(COMMANDS *c, char **environment) {
+    if (c->environment) {
+        return;
+    }
+    int n = 0;
+    while (environment[n]) {
+        n++;
+    }
+    c->environment = (char **)arenaAlloc(c, sizeof(char *) * (n + 1));
+    int i;
+    for (i = 0; i < n; i++) {
+        c->environment[i] = arenaString(c, environment[i], strlen(environment[i]));
+    }
+    c->environment[n] = 0;
+    c->envn = n;
+    for (i = 0; i < c->capacity; i++) {
+        if (c->table[i]) {
+            buildEnvp(c, c->table[i]);
+        }
+    }
+}
+
+// Function: sizeCOMMANDS
+// Takes in a COMMANDS table
+// Returns the number of distinct commands in it.
+
+int sizeCOMMANDS(COMMANDS *c) {
+    return c->count;
+}
+
+// Function: bytesCOMMANDS
+// Takes in a COMMANDS table
+// Returns the bytes of arena its commands and the environment take up.
+
+size_t bytesCOMMANDS(COMMANDS *c) {
+    return c->bytes;
+}
+
+// Function: freeCOMMANDS
+// Takes in a COMMANDS table
+// Frees it along with every COMMAND it handed out.
+// Returns nothing.
+
+void freeCOMMANDS(COMMANDS *c) {
+    while (c->blocks) {
+        BLOCK *next = c->blocks->next;
+        free(c->blocks);
+        c->blocks = next;
+    }
+    free(c->table);
+    free(c);
+}
+
+// Static function: arenaAlloc
+// Takes in a COMMANDS table and a size
+// Returns size bytes from the arena, aligned for pointers. Blocks are never
+//     moved, so what is handed out stays put.
+
+static void *arenaAlloc(COMMANDS *c, size_t size) {
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    BLOCK *b = c->blocks;
+    if (!b || b->size - b->used < size) {
+        size_t block = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+        b = (BLOCK *)malloc(sizeof(BLOCK) + block);
+        assert(b != 0);
+        b->used = 0;
+        b->size = block;
+        // a big request shouldn't strand the rest of the current block
+        if (size > BLOCK_SIZE && c->blocks) {
+            b->next = c->blocks->next;
+            c->blocks->next = b;
+        } else {
+            b->next = c->blocks;
+            c->blocks = b;
+        }
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    c->bytes += size;
+    return p;
+}
+
+// Static function: arenaString
+// Takes in a COMMANDS table, a string and its length
+// Returns a copy of the string in the arena.
+
+static char *arenaString(COMMANDS *c, const char *s, size_t len) {
+    char *copy = (char *)arenaAlloc(c, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Static function: normalize
+// Takes in a command line and a buffer at least as long
+// Copies the words of the line into key, separated by single spaces.
+// Returns the number of words.
+
+static int normalize(const char *line, char *key) {
+    int words = 0;
+    char *k = key;
+    while (*line) {
+        while (isspace((unsigned char)*line)) {
+            line++;
+        }
+        if (!*line) {
+            break;
+        }
+        if (words++ > 0) {
+            *k++ = ' ';
+        }
+        while (*line && !isspace((unsigned char)*line)) {
+            *k++ = *line++;
+        }
+    }
+    *k = '\0';
+    return words;
+}
+
+// Static function: hash
+// Takes in a string
+// Returns its 64-bit FNV-1a hash.
+
+static uint64_t hash(const char *s) {
+    uint64_t h = 14695981039346656037ULL;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Static function: insertTable
+// Takes in a COMMANDS table and a command not yet in it
+// Adds the command, doubling the table first if it would be over half full.
+// Returns nothing.
+
+static void insertTable(COMMANDS *c, COMMAND *cmd) {
+    if (2 * (c->count + 1) > c->capacity) {
+        COMMAND **old = c->table;
+        int old_capacity = c->capacity;
+        c->capacity *= 2;
+        c->table = (COMMAND **)calloc(c->capacity, sizeof(COMMAND *));
+        assert(c->table != 0);
+        c->count = 0;
+        int i;
+        for (i = 0; i < old_capacity; i++) {
+            if (old[i]) {
+                insertTable(c, old[i]);
+            }
+        }
+        free(old);
+    }
+    int mask = c->capacity - 1;
+    int i = hash(cmd->text) & mask;
+    while (c->table[i]) {
+        i = (i + 1) & mask;
+    }
+    c->table[i] = cmd;
+    c->count++;
+}
+
+// Static function: isAssignment
+// Takes in a word
+// Returns 1 if it is NAME=value, as the shell would take it, 0 if not.
+
+static int isAssignment(const char *word) {
+    if (!isalpha((unsigned char)*word) && *word != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char)*word) || *word == '_') {
+        word++;
+    }
+    return *word == '=';
+}
+
+// Static function: findPath
+// Takes in a COMMANDS table and a program name
+// Looks the name up in PATH, as execvp() would, unless it has a '/'.
+// Returns the path to execve(), in the arena; the name itself if it has a
+//     '/' or isn't found, so the exec fails as execvp() would have.
+
+static const char *findPath(COMMANDS *c, const char *name) {
+    const char *dirs = getenv("PATH");
+    if (strchr(name, '/') || !dirs) {
+        return name;
+    }
+    char path[PATH_SIZE];
+    while (*dirs) {
+        size_t len = strcspn(dirs, ":");
+        int n = len ? snprintf(path, PATH_SIZE, "%.*s/%s", (int)len, dirs, name)
+                    : snprintf(path, PATH_SIZE, "%s", name); // "" is the cwd
+        if (n < PATH_SIZE && access(path, X_OK) == 0) {
+            return arenaString(c, path, n);
+        }
+        dirs += len + (dirs[len] == ':');
+    }
+    return name;
+}
+
+// Static function: buildEnvp
+// Takes in a sealed COMMANDS table and one of its commands
+// Builds the command's envp: its assignments, then the environment without
+//     the variables they set.
+// Returns nothing.
+
+static void buildEnvp(COMMANDS *c, COMMAND *cmd) {
+    char **assignments = cmd->argv - cmd->envc;
+    cmd->envp = (char **)arenaAlloc(c, sizeof(char *) * (cmd->envc + c->envn + 1));
+    int n = 0, i, j;
+    for (i = 0; i < cmd->envc; i++) {
+        cmd->envp[n++] = assignments[i];
+    }
+    for (i = 0; i < c->envn; i++) {
+        const char *var = c->environment[i];
+        size_t len = strcspn(var, "=") + 1;
+        for (j = 0; j < cmd->envc && strncmp(assignments[j], var, len) != 0; j++) {
+        }
+        if (j == cmd->envc) {
+            cmd->envp[n++] = c->environment[i];
+        }
+    }
+    cmd->envp[n] = 0;
+}
@@ -0,0 +1,38 @@
+/****************************************************************\
+ * FILE: command.h
+ * This is the header file for the command table module.
+ * A COMMANDS table interns job command lines into one string arena.
+ * Each distinct line is split, looked up in PATH and turned into
+ * ready-made argv and envp arrays once; identical lines share them.
+ * Starting a job is then a single execve() with no allocation or
+ * parsing in the child.
+ *
+ * A command line is whitespace separated words, with any leading
+ * NAME=value words added to the job's environment, as in the shell.
+\****************************************************************/
+
+#ifndef __COMMAND_INCLUDED__
+#define __COMMAND_INCLUDED__
+
+#include <stddef.h>
+
+typedef struct command_struct {
+    const char *text; // The line, words separated by single spaces
+    const char *path; // What to execve(): argv[0], found in PATH if it has
+    // no '/'
+    char **argv;
+    char **envp; // The NAME=value words, then the base environment
+    int argc;
+    int envc; // Number of NAME=value words
+} COMMAND;
+
+typedef struct commands COMMANDS;
+
+extern COMMANDS *newCOMMANDS(void);
+extern const COMMAND *internCOMMANDS(COMMANDS *c,const char *line);
+extern void sealCOMMANDS(COMMANDS *c,char **environment);
+extern int sizeCOMMANDS(COMMANDS *c);
+extern size_t bytesCOMMANDS(COMMANDS *c);
+extern void freeCOMMANDS(COMMANDS *c);
+
+#endif
@@ -0,0 +1,446 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "control.h"
+
+#define MAX_CLIENTS 64
+#define CLIENT_BUF 65536 // Longest run of input kept for a partial line
+#define REPLY_SIZE 64
+
+typedef struct client_struct {
+    int fd; // -1 if the slot is free
+    unsigned generation; // Bumped when the slot is reused
+    int len; // Bytes of an incomplete line held in buf
+    char buf[CLIENT_BUF];
+} client;
+
+struct control {
+    int listen_fd;
+    int wake_fd; // eventfd, written when there are replies or on shutdown
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    pthread_t thread;
+    _Atomic(REQUEST *) requests; // To the scheduler, newest first
+    _Atomic(REQUEST *) replies; // From the scheduler, newest first
+    _Atomic int stop;
+    int next_id; // Only used by the control thread
+    int shutting_down; // A shutdown has been queued; only used by the
+    // control thread
+    client clients[MAX_CLIENTS];
+};
+
+static void *serve(void *arg);
+static void acceptClient(CONTROL *c);
+static void readClient(CONTROL *c,int i);
+static int parseLine(CONTROL *c,char *line,REQUEST *r);
+static void sendReplies(CONTROL *c);
+static void sendLine(CONTROL *c,int i,const char *text);
+static void closeClient(CONTROL *c,int i);
+static void push(_Atomic(REQUEST *) *list,REQUEST *first,REQUEST *last);
+static REQUEST *takeAll(_Atomic(REQUEST *) *list);
+
+// Function: newCONTROL
+// Takes in the path for the socket and the id to give the first job
+//     submitted through it.
+// Creates the socket, replacing any stale one at path, and starts the
+//     control thread with all signals blocked.
+// Returns the new CONTROL, or NULL with errno set.
+
+CONTROL *newCONTROL(const char *path, int first_id) {
+    CONTROL *c = (CONTROL *)calloc(1, sizeof(CONTROL));
+    assert(c != 0);
+    if (strlen(path) >= sizeof(c->path)) {
+        free(c);
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    strcpy(c->path, path);
+    c->next_id = first_id;
+    int i;
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        c->clients[i].fd = -1;
+    }
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    c->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    c->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    unlink(path);
+    if (c->listen_fd < 0 || c->wake_fd < 0
+        || bind(c->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(c->listen_fd, MAX_CLIENTS) < 0) {
+        int saved = errno;
+        close(c->listen_fd);
+        close(c->wake_fd);
+        free(c);
+        errno = saved;
+        return 0;
+    }
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    int rc = pthread_create(&c->thread, 0, serve, c);
+    pthread_sigmask(SIG_SETMASK, &saved, 0);
+    if (rc != 0) {
+        close(c->listen_fd);
+        close(c->wake_fd);
+        unlink(path);
+        free(c);
+        errno = rc;
+        return 0;
+    }
+    return c;
+}
+
+// Function: takeCONTROL
+// Takes in a CONTROL
+// Called by the scheduler: takes every request made so far without waiting
+//     for the control thread. Submissions must be freed by the caller; every
+//     other request must be answered with replyCONTROL.
+// Returns the requests in the order they were made, linked by next.
+
+REQUEST *takeCONTROL(CONTROL *c) {
+    return takeAll(&c->requests);
+}
+
+// Function: replyCONTROL
+// Takes in a CONTROL, a request taken from it and the reply, one line
+//     without the newline
+// Hands the reply to the control thread to send; the request is freed once
+//     it has been.
+
+void replyCONTROL(CONTROL *c, REQUEST *r, const char *text) {
+    size_t len = strlen(text);
+    r->reply = (char *)malloc(len + 2);
+    assert(r->reply != 0);
+    memcpy(r->reply, text, len);
+    strcpy(r->reply + len, "\n");
+    push(&c->replies, r, r);
+    uint64_t one = 1;
+    if (write(c->wake_fd, &one, sizeof(one)) < 0) {
+        // the counter can only be full if there is a wakeup pending anyway
+    }
+}
+
+// Function: closeCONTROL
+// Takes in a CONTROL
+// Sends any replies still waiting, stops the control thread, closes every
+//     connection and removes the socket, then frees the CONTROL.
+// Returns the requests made that were never taken, in the order they were
+//     made, linked by next; they can no longer be replied to.
+
+REQUEST *closeCONTROL(CONTROL *c) {
+    atomic_store(&c->stop, 1);
+    uint64_t one = 1;
+    if (write(c->wake_fd, &one, sizeof(one)) < 0) {
+    }
+    pthread_join(c->thread, 0);
+    int i;
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (c->clients[i].fd >= 0) {
+            close(c->clients[i].fd);
+        }
+    }
+    REQUEST *r = takeAll(&c->requests);
+    close(c->listen_fd);
+    close(c->wake_fd);
+    unlink(c->path);
+    free(c);
+    return r;
+}
+
+// Function: freeCONTROL
+// Takes in a CONTROL
+// Closes it as closeCONTROL does, dropping the requests never taken.
+
+void freeCONTROL(CONTROL *c) {
+    REQUEST *r = closeCONTROL(c);
+    while (r) {
+        REQUEST *next = r->next;
+        free(r->command);
+        free(r);
+        r = next;
+    }
+}
+
+// Static function: serve
+// Takes in the CONTROL
+// The control thread: accepts connections, turns what clients send into
+//     requests, and sends back the scheduler's replies.
+
+static void *serve(void *arg) {
+    CONTROL *c = (CONTROL *)arg;
+    struct pollfd fds[MAX_CLIENTS + 2];
+    while (!atomic_load(&c->stop)) {
+        fds[0] = (struct pollfd){ c->listen_fd, POLLIN, 0 };
+        fds[1] = (struct pollfd){ c->wake_fd, POLLIN, 0 };
+        int i;
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            fds[i + 2] = (struct pollfd){ c->clients[i].fd, POLLIN, 0 };
+        }
+        if (poll(fds, MAX_CLIENTS + 2, -1) < 0) {
+            continue;
+        }
+        if (fds[1].revents) {
+            uint64_t n;
+            if (read(c->wake_fd, &n, sizeof(n)) < 0) {
+            }
+            sendReplies(c);
+        }
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (fds[i + 2].revents) {
+                readClient(c, i);
+            }
+        }
+        if (fds[0].revents) {
+            acceptClient(c);
+        }
+    }
+    sendReplies(c);
+    return 0;
+}
+
+// Static function: acceptClient
+// Takes in a CONTROL
+// Accepts a connection into a free slot, or turns it away if there is none.
+
+static void acceptClient(CONTROL *c) {
+    int fd = accept4(c->listen_fd, 0, 0, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    int i;
+    for (i = 0; i < MAX_CLIENTS && c->clients[i].fd >= 0; i++) {
+    }
+    if (i == MAX_CLIENTS) {
+        const char *busy = "error too many clients\n";
+        send(fd, busy, strlen(busy), MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(fd);
+        return;
+    }
+    c->clients[i].fd = fd;
+    c->clients[i].len = 0;
+    c->clients[i].generation++;
+}
+
+// Static function: readClient
+// Takes in a CONTROL and a client slot
+// Reads what the client has sent and handles each complete line. Runs of
+//     submissions are queued for the scheduler as one batch, with one
+//     compare-and-swap, and acknowledged with the ids they were given.
+
+static void readClient(CONTROL *c, int i) {
+    client *cl = &c->clients[i];
+    ssize_t n = read(cl->fd, cl->buf + cl->len, CLIENT_BUF - 1 - cl->len);
+    if (n <= 0) {
+        closeClient(c, i);
+        return;
+    }
+    cl->len += n;
+    cl->buf[cl->len] = '\0';
+    REQUEST *first = 0, *last = 0;
+    int count = 0;
+    char reply[REPLY_SIZE];
+    char *line = cl->buf, *end;
+    while ((end = strchr(line, '\n'))) {
+        *end = '\0';
+        REQUEST *r = (REQUEST *)calloc(1, sizeof(REQUEST));
+        assert(r != 0);
+        r->client = i;
+        r->generation = cl->generation;
+        int ok = parseLine(c, line, r);
+        line = end + 1;
+        if (ok > 0 && r->type == REQ_SUBMIT) {
+            if (last) {
+                last->next = r;
+            } else {
+                first = r;
+            }
+            last = r;
+            count++;
+            continue;
+        }
+        if (first) {
+            snprintf(reply, REPLY_SIZE, "ok %d %d\n", first->id, count);
+            push(&c->requests, first, last);
+            sendLine(c, i, reply);
+            first = last = 0;
+            count = 0;
+        }
+        if (ok > 0) {
+            push(&c->requests, r, r);
+        } else {
+            free(r);
+            sendLine(c, i, ok < 0 ? "error shutting down\n" : "error bad command\n");
+        }
+        if (cl->fd < 0) {
+            break;
+        }
+    }
+    if (first) {
+        snprintf(reply, REPLY_SIZE, "ok %d %d\n", first->id, count);
+        push(&c->requests, first, last);
+        sendLine(c, i, reply);
+    }
+    if (cl->fd < 0) {
+        return;
+    }
+    cl->len -= line - cl->buf;
+    memmove(cl->buf, line, cl->len);
+    if (cl->len == CLIENT_BUF - 1) {
+        sendLine(c, i, "error line too long\n");
+        closeClient(c, i);
+    }
+}
+
+// Static function: parseLine
+// Takes in a CONTROL, a line without its newline and a request to fill in
+// Returns 1 if the line is a valid command, 0 if not, and -1 if it is a
+//     submission after a shutdown, which is refused without using an id.
+
+static int parseLine(CONTROL *c, char *line, REQUEST *r) {
+    char *args = line;
+    if (strncmp(line, "submit ", 7) == 0) {
+        args = line + 7;
+    } else if (strcmp(line, "query") == 0) {
+        r->type = REQ_QUERY;
+        return 1;
+    } else if (strcmp(line, "shutdown") == 0) {
+        r->type = REQ_SHUTDOWN;
+        c->shutting_down = 1;
+        return 1;
+    } else if (sscanf(line, "cancel %d", &r->id) == 1) {
+        r->type = REQ_CANCEL;
+        return 1;
+    } else if (strncmp(line, "checkpoint ", 11) == 0 || strncmp(line, "restart ", 8) == 0) {
+        r->type = line[0] == 'c' ? REQ_CHECKPOINT : REQ_RESTART;
+        args = strchr(line, ' ');
+        while (*args == ' ') {
+            args++;
+        }
+        if (!*args) {
+            return 0;
+        }
+        r->command = strdup(args);
+        assert(r->command != 0);
+        return 1;
+    }
+    while (*args == ' ') {
+        args++;
+    }
+    if (*args == '+') {
+        r->relative = 1;
+        args++;
+    }
+    int len = 0;
+    if (sscanf(args, "%lf,%d,%d%n", &r->arrival, &r->priority, &r->proc_time, &len) != 3
+        || r->arrival < 0 || r->priority < 0 || r->priority > 3) {
+        return 0;
+    }
+    // the command is split and interned by the scheduler
+    if (args[len] == ',') {
+        r->command = strdup(args + len + 1);
+        assert(r->command != 0);
+    }
+    if (c->shutting_down) {
+        free(r->command);
+        r->command = 0;
+        return -1;
+    }
+    r->type = REQ_SUBMIT;
+    r->id = c->next_id++;
+    return 1;
+}
+
+// Static function: sendReplies
+// Takes in a CONTROL
+// Sends the replies the scheduler has made to clients still connected, and
+//     frees their requests.
+
+static void sendReplies(CONTROL *c) {
+    REQUEST *r = takeAll(&c->replies);
+    while (r) {
+        REQUEST *next = r->next;
+        client *cl = &c->clients[r->client];
+        if (cl->fd >= 0 && cl->generation == r->generation) {
+            sendLine(c, r->client, r->reply);
+        }
+        free(r->reply);
+        free(r);
+        r = next;
+    }
+}
+
+// Static function: sendLine
+// Takes in a CONTROL, a client slot and text
+// Sends the text without waiting; a client too slow to take it is dropped.
+
+static void sendLine(CONTROL *c, int i, const char *text) {
+    client *cl = &c->clients[i];
+    if (cl->fd < 0) {
+        return;
+    }
+    ssize_t len = strlen(text);
+    if (send(cl->fd, text, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len) {
+        closeClient(c, i);
+    }
+}
+
+// Static function: closeClient
+// Takes in a CONTROL and a client slot
+// Closes the connection and frees the slot.
+
+static void closeClient(CONTROL *c, int i) {
+    close(c->clients[i].fd);
+    c->clients[i].fd = -1;
+}
+
+// Static function: push
+// Takes in a list and a chain of requests, oldest first
+// Pushes the whole chain onto the list with one compare-and-swap. The list
+//     is kept newest first, so the chain is reversed onto it.
+
+static void push(_Atomic(REQUEST *) *list, REQUEST *first, REQUEST *last) {
+    REQUEST *prev = 0, *r = first;
+    while (r != last) {
+        REQUEST *next = r->next;
+        r->next = prev;
+        prev = r;
+        r = next;
+    }
+    last->next = prev;
+    // first is now the oldest, at the far end of the chain
+    REQUEST *head = atomic_load(list);
+    do {
+        first->next = head;
+    } while (!atomic_compare_exchange_weak(list, &head, last));
+}
+
+// Static function: takeAll
+// Takes in a list
+// Empties it with one exchange; as there is only one taker, no request can
+//     be freed and reused in between.
+// Returns what was on it, oldest first.
+
+static REQUEST *takeAll(_Atomic(REQUEST *) *list) {
+    REQUEST *r = atomic_exchange(list, 0);
+    REQUEST *prev = 0;
+    while (r) {
+        REQUEST *next = r->next;
+        r->next = prev;
+        prev = r;
+        r = next;
+    }
+    return prev;
+}
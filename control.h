@@ -0,0 +1,53 @@
+/****************************************************************\
+ * FILE: control.h
+ * This is the header file for the control socket module.
+ * A CONTROL listens on a Unix domain socket from its own thread.
+ * Clients send one command per line:
+ *
+ *   submit ARRIVAL,PRIORITY,PROC_TIME[,DEADLINE][,@ID ID ...][,COMMAND]
+ *          (or just the list line)
+ *   query
+ *   cancel ID
+ *   checkpoint PATH
+ *   restart PATH
+ *   shutdown
+ *
+ * ARRIVAL is in seconds since tick 0, or "+SECONDS" from now. Runs
+ * of submissions become one batch, acknowledged at once with
+ * "ok FIRST_ID COUNT"; once a shutdown has been sent, on any
+ * connection, they are refused with "error shutting down". Every
+ * command reaches the scheduler as a REQUEST on a lock-free queue
+ * that it empties once per tick; the replies to the other commands
+ * are sent when it has answered them.
+\****************************************************************/
+
+#ifndef __CONTROL_INCLUDED__
+#define __CONTROL_INCLUDED__
+
+enum request_type { REQ_SUBMIT, REQ_QUERY, REQ_CANCEL, REQ_CHECKPOINT, REQ_RESTART,
+                    REQ_SHUTDOWN };
+
+typedef struct request_struct {
+    struct request_struct *next;
+    int type; // a request_type
+    int id; // The job submitted or to cancel
+    double arrival; // Seconds; from now if relative is set
+    int relative;
+    int priority;
+    int proc_time;
+    char *command; // Text after PROC_TIME, if any, or the PATH of a
+    // checkpoint or restart; the taker frees it
+    int client; // Who to reply to, and which connection in that slot
+    unsigned generation;
+    char *reply; // Set by replyCONTROL
+} REQUEST;
+
+typedef struct control CONTROL;
+
+extern CONTROL *newCONTROL(const char *path,int first_id);
+extern REQUEST *takeCONTROL(CONTROL *c);
+extern void replyCONTROL(CONTROL *c,REQUEST *r,const char *text);
+extern REQUEST *closeCONTROL(CONTROL *c);
+extern void freeCONTROL(CONTROL *c);
+
+#endif
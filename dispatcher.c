@@ -1,22 +1,110 @@
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include "cgroup.h"
+#include "jobshm.h"
+#include "joblog.h"
+#include "tracer.h"
+#include "control.h"
+#include "command.h"
+#include "sweep.h"
+#include "fiber.h"
+#include "wheel.h"
+#include "snapshot.h"
 
 #define BUF_SIZE 1024
 #define TIME_QUANTUM 1
+#define USEC_PER_SEC 1000000
+#define TICK_US ((int64_t)TIME_QUANTUM * USEC_PER_SEC)
+#define DEFAULT_PREEMPT_BOUND_MS 50
+#define DEFAULT_OVERLAP_BOUND_MS 10
+#define DEFAULT_RING_SLOTS 256
+#define DEFAULT_YIELD_TIMEOUT_MS 20
+#define DEFAULT_LOG_SIZE_KB 1024
+#define LOG_PIPE_SIZE (256 * 1024) // Output a process can write before it
+// blocks, if the dispatcher hasn't got round to its pipe
+#define LOG_BUDGET (64 * 1024) // Most output moved from one pipe per pass
+#define TRACE_BUFFER (1024 * 1024) // Bytes of records the writer can lag by
+#define TRACE_LINE 4096 // Longest trace record; queue dumps are cut short
+#define EVENT_BATCH 256
+#define DEFAULT_COMMAND "./process 20" // What jobs without a command run
+#define DEFAULT_FIBER_COMMAND "spin" // The same, with --fibers
+#define DEFAULT_EDF_BOUND 100
+#define DEFAULT_AFFINITY_IMBALANCE 2
+#define DEFAULT_FIFO_PRIORITY 10
+#define PREFAULT_STACK (256 * 1024) // Stack faulted in for --low-jitter
+#define LATE_BUCKETS 24 // Powers of two of microseconds a tick can be late by
+#define QUEUE_RESERVE 1024 // Slots each run queue starts with; none shrinks
 
-enum proc_state { ready, waiting };
+enum overflow { OVERFLOW_DEFER, OVERFLOW_SPILL, OVERFLOW_REJECT };
+
+enum proc_state { pending, ready, waiting, finished };
 
 typedef struct process_struct {
+    int id; // Position in the dispatch list
     int arrival_time;
     int priority;
     int proc_time;
     enum proc_state state;
     pid_t pid;
+    int64_t arrival_us; // Arrival in microseconds; may fall between ticks
+    int64_t start_us; // When the process was first started, or -1
+    int64_t end_us; // When it finished, or -1
+    int64_t stop_us; // When a pipelined suspension began, or -1 once the
+    // stop has been confirmed
+    CGROUP *cg; // The process's cgroup, if it was started in one
+    int service_time; // proc_time as given in the dispatch list
+    int ticks; // Ticks the process held the CPU for
+    int64_t cpu_us; // CPU time it has actually used, children included
+    int stat_fd; // Open /proc/<pid>/stat, re-read to sample cpu_us
+    int pidfd; // Becomes readable when the process exits, or -1
+    int64_t resumed_us; // When the process last started or resumed
+    JOBSLOT *slot; // Where the process reports its events, if in ring mode
+    int parked; // Suspended by asking it to yield rather than by a signal
+    int out_fd; // Read end of the pipe its stdout and stderr go to, or -1
+    JOBLOG *log; // Where that output is spliced to
+    const COMMAND *cmd; // What the process runs, shared by identical jobs
+    FIBER *fiber; // With --fibers, what runs its task, or 0
+    int heap_index; // Position in an SRTF policy's heap or the EDF heap, or -1
+    int64_t deadline_us; // When it must have finished by, or -1 for no deadline
+    int edf; // Admitted to the EDF tier
+    double density; // Its share of the EDF tier's CPU until it finishes
+    int waiting_on; // Dependencies that haven't finished
+    struct process_struct **dependents; // Processes waiting on this one
+    int num_dependents, dependents_cap;
+    int critical; // On the critical path of its dependency graph
+    TIMER arrival_timer; // Pending until it arrives
+    TIMER deadline_timer; // Pending from arrival until it finishes, if it
+    // has a deadline
+    unsigned long long pid_start; // When its pid started, from a snapshot
+    int adopted; // Restored from a snapshot another dispatcher took, so not
+    // a child: its exit is seen through its pidfd, and init reaps it
+    int deferred; // Arrived while its run queue was full, and held back
+    int last_cpu; // The CPU it was last seen on in /proc, or -1
+    int home; // The CPU it is pinned to under --affinity, or -1
+    int sigstopped; // Stopped with SIGSTOP as its freeze couldn't be
+    // confirmed, so thawing alone won't resume it
+    int exited; // Reaped while being waited for to stop, and never to be
+    // signalled again; reap_process finishes it off
 } process;
 
 struct da {
@@ -34,223 +122,3655 @@ struct cda {
     // back; we can compute it with the front and the size.
     void **arr;
     void (*display)(FILE *, void *);
+    int reserved; // Set by reserveCDA: the array grows but never shrinks
 };
 
-typedef struct cda CDA;
+typedef struct cda CDA;
+
+// Ready processes in the order compare puts them in, each knowing its
+// position so it can be taken out from anywhere.
+
+typedef struct heap_struct {
+    process **arr;
+    int size, cap;
+    int (*compare)(process *, process *);
+} heap;
+
+typedef struct dispatcher_struct {
+    CDA *dispatch_queue;
+    CDA **rq;
+    process *currently_running;
+    int curr_time;
+    int num_procs_processed;
+    WHEEL *timers; // The arrivals of pending processes and the deadlines
+    // of live ones
+    heap ready[4]; // The run queues of the SRTF policies
+    heap edf; // Admitted deadline processes, on their deadlines
+    double edf_load; // Sum of their densities
+    CDA *deferred[4]; // Arrivals held back while the run queue they go in is
+    // full, by that queue, in the order they arrived
+} dispatcher;
+
+typedef struct options_struct {
+    int preempt_bound_ms; // How often arrivals are checked between ticks; 0
+    // leaves admission to the tick boundary.
+    int stats; // Print a report to stderr on exit
+    int pipelined; // Start the next process without waiting for the
+    // previous one to stop
+    int overlap_bound_ms; // Longest two processes may run together when
+    // pipelined
+    char *cgroup; // Delegated cgroup v2 directory to start processes under
+    int charge_cpu; // Charge processes for the CPU time they used rather
+    // than one unit per tick held
+    int wait_for_tick; // Leave the CPU idle until the next tick when a
+    // process exits early, rather than dispatching at once
+    int ring_slots; // Have processes report events through a shared-memory
+    // ring with this many slots instead of stdout; 0 to leave them on stdout
+    int verbose; // Print the events drained from the ring
+    int yield_timeout_ms; // Ask cooperative processes to yield through the
+    // ring, falling back to signals if one hasn't parked after this long; 0
+    // always uses signals
+    char *log_dir; // Capture each process's output into a log under here
+    int log_by_level; // One log per priority level rather than per process
+    int log_size_kb; // Size at which a log is rotated, or 0 for no limit
+    char *trace_file; // Log every scheduling decision here, "-" for stdout
+    int trace_policy; // What to do with records when the writer is behind
+    char *socket_path; // Accept commands on this Unix socket
+    int simulate; // Run no processes: each job uses its whole service
+    // time, against a virtual clock that jumps straight to the next event
+    int fibers; // Run jobs as fibers in the dispatcher, not as processes
+    char *sweep; // Simulate every configuration in this spec instead
+    int threads; // Simulations to run at once when sweeping, 0 for one per
+    // CPU
+    const char *policy; // Name of the scheduling policy
+    int edf_bound; // Percentage of the CPU processes with deadlines may be
+    // admitted to the EDF tier up to
+    int edf_reject; // Reject processes that fail the admission test rather
+    // than run them without the tier
+    int critical_path; // Admit processes on the critical path of their
+    // dependency graph at the highest non-system priority
+    char *restore; // Resume from this snapshot instead of a dispatch list
+    int queue_limits[4]; // Most processes each run queue admits to, 0 for
+    // no limit
+    int overflow; // What becomes of an arrival whose run queue is full
+    int affinity; // Pin each process to a CPU, moving it only when its CPU
+    // is home to this many more processes than another; 0 leaves placement
+    // to the kernel
+    int low_jitter; // SCHED_FIFO priority to run the ticks at, with memory
+    // locked; 0 for neither
+} options;
+
+// How jobs are run. The policy in main decides what holds the CPU; a backend
+// makes it so, and passes the time until the next tick.
+
+typedef struct backend_struct {
+    const char *name;
+    int virtual_clock; // Keeps its own clock, in virtual_us, rather than
+    // reading the real one
+    void (*start)(process *);
+    void (*suspend)(process *);
+    void (*restart)(process *);
+    void (*terminate)(process *);
+    void (*wait)(dispatcher *, int64_t); // Until a time since tick 0
+} backend;
+
+// What holds the CPU. A policy keeps the ready processes in the run queues
+// however it likes; main tells it of arrivals, exits and processes switched
+// out, and asks it at each tick, and when it asks to preempt, what to run.
+
+typedef struct policy_struct {
+    const char *name;
+    int (*on_arrival)(dispatcher *, process *); // Queues a process; returns 1
+    // if it should preempt the running process at once rather than at a tick
+    process *(*pick_next)(dispatcher *, int); // Takes the process to run off
+    // its queue, or returns 0 to leave the CPU as it is. The flag is set at a
+    // tick, when the running process's quantum has expired
+    void (*on_quantum_expired)(dispatcher *, process *); // Queues a process
+    // being switched out
+    void (*on_exit)(dispatcher *, process *); // Forgets a process that has
+    // finished or been cancelled, running or not
+    int (*format)(dispatcher *, char *, int); // The run queues, for the trace
+    int levels; // Run queues it keeps by priority; with 1, every process
+    // goes in the first whatever its priority
+} policy;
+
+typedef struct statistics_struct {
+    int switches;
+    int64_t switch_us; // Total time from suspending a process to having
+    // started or resumed the next one
+    int stops;
+    int64_t stop_us; // Total time from SIGTSTP to a confirmed stop
+    int64_t max_overlap_us;
+    int safeguards; // Times the overlap bound had to be enforced
+    int early_exits; // Processes that exited before being terminated
+    int64_t busy_us; // Total time some process was running
+    int64_t events; // Events drained from the ring
+    int64_t events_dropped; // Events lost to a full ring
+    int yield_switches; // Context switches from a process that yielded
+    int64_t yield_switch_us;
+    int yields;
+    int64_t yield_us; // Total time from asking a process to yield to it parking
+    int64_t loop_cpu_ns; // CPU time the dispatcher took over the ticks
+    long long startup_allocs; // Heap allocations before tick 0, if counted
+    long long tick_allocs; // Heap allocations the ticks made
+    int alloc_ticks; // Ticks that made any
+    int last_alloc_tick;
+    int restored; // Jobs read back from a snapshot
+    int64_t restore_us; // Time from mapping it to adopting the processes
+    int adopted; // Processes still alive that were taken back
+    int lost; // Processes that had exited with no dispatcher to see it
+    int edf_admitted;
+    int edf_downgraded; // Failed the admission test and were run by the policy
+    int edf_rejected;
+    int dependencies; // Edges of the dependency graphs
+    int held; // Processes that had to wait on one past their arrival
+    int boosted; // Critical processes raised to priority 1
+    int yield_fallbacks; // Yields that timed out and fell back to signals
+    long long log_bytes; // Output captured into logs
+    int submitted; // Jobs submitted through the socket
+    int cancelled;
+    int queue_max[4]; // Deepest each run queue has been
+    int64_t queue_sum[4]; // Depths at each tick, for the mean
+    int deferred; // Arrivals held back by a full run queue
+    int max_deferred; // Most held back at once
+    int64_t defer_us; // Total time they were held back
+    int64_t max_defer_us;
+    int spilled; // Arrivals queued a level down for a full run queue
+    int shed; // Arrivals rejected for one
+    int migrations; // Times a process was seen on another CPU than before
+    int kept_cpu; // Resumes on the CPU the process last ran on
+    int moved_cpu; // Resumes moved elsewhere to even out the homes
+    int late_ticks; // Ticks whose lateness was measured
+    int64_t late_us; // Total time they started after they were due
+    int64_t max_late_us;
+    long long late_hist[LATE_BUCKETS]; // Ticks late by under 1 us, then by
+    // under 2, 4, 8 and so on
+    int fifo; // Got SCHED_FIFO for --low-jitter
+    int locked; // Got its memory locked
+    TRACERSTATS out; // The writers' counters, once they have finished
+    TRACERSTATS trace;
+} statistics;
+
+static options opts = { DEFAULT_PREEMPT_BOUND_MS, 0, 0, DEFAULT_OVERLAP_BOUND_MS, 0, 0, 0, 0, 0, 0,
+                        0, 0, DEFAULT_LOG_SIZE_KB, 0, TRACE_DROP, 0, 0, 0, 0, 0,
+                        "mlfq", DEFAULT_EDF_BOUND, 0, 0, 0, { 0, 0, 0, 0 }, OVERFLOW_DEFER, 0, 0 };
+static statistics stats;
+static int64_t epoch_us; // Monotonic time at which tick 0 started
+static int64_t virtual_us; // The clock, when the backend keeps its own
+static int64_t clock_epoch_us; // Monotonic time at tick 0, whatever the clock
+static sigset_t chld_mask; // SIGCHLD, blocked so it can be waited for
+static int chld_fd; // signalfd for chld_mask
+static DA *stopping; // Processes suspended while pipelined whose stop has
+// not been confirmed yet
+static CGROUP *run_cg; // Parent of the processes' cgroups, or 0 to control
+// processes through their process groups only
+static JOBSHM *ring; // Shared-memory event rings, or 0 if not in ring mode
+static DA *capturing; // Processes whose output pipe is still open
+static JOBLOG *level_logs[4]; // With --log-by=level, opened as needed
+static TRACER *out; // Writes to stdout for the dispatcher, with -v
+static TRACER *tracer; // Writes the trace, or 0; may be out
+static CONTROL *control; // The control socket, if any
+static int accepting; // Keep running, idle if need be, for more jobs
+static COMMANDS *commands; // Every job's command, interned once
+static const COMMAND *default_command;
+static char **restart_argv; // The options, for a restart
+static int restart_argc;
+static int64_t restore_start_us; // When restoring began
+static int restored_accepting; // The snapshot's dispatcher was taking jobs
+static cpu_set_t allowed_cpus; // Where processes may be pinned, with --affinity
+static int num_cpus;
+static int *cpu_homes; // Live processes pinned to each CPU
+
+// Defined by bench/alloccount.so when it is preloaded, and 0 otherwise.
+extern long long alloc_count(void) __attribute__((weak));
+
+void usage(void);
+int64_t now_us(void);
+int64_t clock_us(void);
+int64_t elapsed_us(void);
+void count_allocs(long long *, int);
+void note_lateness(int64_t);
+void enter_low_jitter(void);
+void prefault_stack(void);
+int admit_arrivals(dispatcher *, int64_t);
+int admit(dispatcher *, process *);
+int admit_deadline(dispatcher *, process *);
+int fits_edf(dispatcher *, process *);
+int make_room(dispatcher *, process *);
+int room_for(dispatcher *, process *);
+int queue_of(process *);
+int queue_full(dispatcher *, int);
+int queue_depth(dispatcher *, int);
+void note_depths(dispatcher *, int);
+int add_dependencies(dispatcher *, process *, const char *);
+int release_dependents(dispatcher *, process *);
+void mark_critical_paths(dispatcher *);
+int find_root(int *, int);
+process *pick(dispatcher *, int);
+void requeue(dispatcher *, process *);
+int forget(dispatcher *, process *);
+void dispatch(dispatcher *);
+void preempt(dispatcher *);
+void switch_to(dispatcher *, process *);
+int leave_cpu(dispatcher *);
+int mlfq_arrival(dispatcher *, process *);
+process *mlfq_pick(dispatcher *, int);
+void mlfq_expired(dispatcher *, process *);
+void mlfq_exit(dispatcher *, process *);
+int rr_arrival(dispatcher *, process *);
+process *rr_pick(dispatcher *, int);
+process *fcfs_pick(dispatcher *, int);
+void rr_expired(dispatcher *, process *);
+void rr_exit(dispatcher *, process *);
+int srtf_arrival(dispatcher *, process *);
+process *srtf_pick(dispatcher *, int);
+void srtf_expired(dispatcher *, process *);
+void srtf_exit(dispatcher *, process *);
+int mlfq_srtf_arrival(dispatcher *, process *);
+process *mlfq_srtf_pick(dispatcher *, int);
+void mlfq_srtf_expired(dispatcher *, process *);
+void mlfq_srtf_exit(dispatcher *, process *);
+int scan_arrival(dispatcher *, process *);
+process *scan_pick(dispatcher *, int);
+process *mlfq_scan_pick(dispatcher *, int);
+process *shortest_in_queue(CDA *);
+int format_queues(dispatcher *, char *, int);
+int format_heaps(dispatcher *, char *, int);
+int format_heap(char *, int, heap *);
+const char *parse_fields(const char *, double *, const char **);
+void heap_push(heap *, process *);
+process *heap_pop(heap *);
+void heap_remove(heap *, process *);
+void heap_place(heap *, int, process *);
+void heap_reserve(heap *, int);
+int compare_remaining(process *, process *);
+int compare_deadlines(process *, process *);
+int64_t cpu_ns(void);
+void confirm_stops(dispatcher *);
+void confirm_stop(process *);
+int64_t next_stop_deadline(void);
+int wait_stopped(process *, int);
+int sample_cpu(process *);
+int reap_process(process *, int);
+pid_t wait_child(process *, int);
+int choose_cpu(process *);
+void pin_process(process *, int);
+void end_run(process *);
+void charge_cpu(process *);
+void wait_for_tick(dispatcher *, int64_t);
+void simulate_tick(dispatcher *, int64_t);
+void drain_events(void);
+int yield_process(process *);
+JOBLOG *open_log(process *);
+int capture_output(process *, int);
+void trace(const char *, ...);
+void trace_tick(dispatcher *);
+int format_queue(char *, int, CDA *);
+void take_requests(dispatcher *);
+void handle_request(dispatcher *, REQUEST *);
+void answer(REQUEST *, const char *);
+const char *checkpoint(dispatcher *, const char *);
+void restart_dispatcher(dispatcher *, REQUEST *);
+int restore(dispatcher *, const char *);
+void adopt_processes(dispatcher *);
+int proc_identity(pid_t, pid_t *, unsigned long long *);
+int adopted_exited(process *, int);
+int cancel_process(dispatcher *, process *);
+void remove_from_queue(CDA *, process *);
+void print_stats(FILE *, dispatcher *);
+void print_writer(FILE *, const char *, TRACERSTATS *);
+int run_sweep(dispatcher *);
+void startProcess(process *);
+void terminateProcess(process *);
+void suspendProcess(process *);
+void restartProcess(process *);
+void start_os(process *);
+void terminate_os(process *);
+void suspend_os(process *);
+void restart_os(process *);
+void start_fiber(process *);
+void terminate_fiber(process *);
+void run_fiber(dispatcher *, int64_t);
+void no_op(process *);
+TIMER *get_procs_with_arrival_time(dispatcher *, int64_t);
+void add_arrival(dispatcher *, process *);
+int64_t next_arrival(dispatcher *);
+TIMER *sort_by_id(TIMER *);
+process *new_proc(double, int, int);
+void display_proc(FILE *, void *);
+
+
+
+static const backend os_backend = { "processes", 0, start_os, suspend_os, restart_os,
+                                    terminate_os, wait_for_tick };
+static const backend sim_backend = { "simulate", 1, no_op, no_op, no_op, no_op, simulate_tick };
+static const backend fiber_backend = { "fibers", 1, start_fiber, no_op, no_op, terminate_fiber,
+                                       run_fiber };
+static const backend *job_backend = &os_backend;
+
+static const policy mlfq_policy = { "mlfq", mlfq_arrival, mlfq_pick, mlfq_expired, mlfq_exit,
+                                    format_queues, 4 };
+static const policy rr_policy = { "rr", rr_arrival, rr_pick, rr_expired, rr_exit,
+                                  format_queues, 1 };
+static const policy fcfs_policy = { "fcfs", rr_arrival, fcfs_pick, rr_expired, rr_exit,
+                                    format_queues, 1 };
+static const policy srtf_policy = { "srtf", srtf_arrival, srtf_pick, srtf_expired, srtf_exit,
+                                    format_heaps, 1 };
+static const policy mlfq_srtf_policy = { "mlfq-srtf", mlfq_srtf_arrival, mlfq_srtf_pick,
+                                         mlfq_srtf_expired, mlfq_srtf_exit, format_heaps, 4 };
+static const policy srtf_scan_policy = { "srtf-scan", scan_arrival, scan_pick, rr_expired,
+                                         rr_exit, format_queues, 1 };
+static const policy mlfq_scan_policy = { "mlfq-srtf-scan", mlfq_arrival, mlfq_scan_pick,
+                                         mlfq_expired, mlfq_exit, format_queues, 4 };
+static const policy *policies[] = { &mlfq_policy, &rr_policy, &fcfs_policy, &srtf_policy,
+                                    &mlfq_srtf_policy, &srtf_scan_policy, &mlfq_scan_policy, 0 };
+static const policy *job_policy = &mlfq_policy;
+
+
+
+DA *newDA(void (*d)(FILE *,void *));
+void insertDA(DA *items,void *value);
+void *removeDA(DA *items);
+void unionDA(DA *recipient,DA *donor);
+void *getDA(DA *items,int index);
+void *setDA(DA *items,int index,void *value);
+void **extractDA(DA *items);
+int sizeDA(DA *items);
+void visualizeDA(FILE *fp,DA *items);
+void displayDA(FILE *fp,DA *items);
+
+
+
+CDA *newCDA(void (*d)(FILE *,void *));
+void insertCDAfront(CDA *items,void *value);
+void insertCDAback(CDA *items,void *value);
+void *removeCDAfront(CDA *items);
+void *removeCDAback(CDA *items);
+void unionCDA(CDA *recipient,CDA *donor);
+void *getCDA(CDA *items,int index);
+void *setCDA(CDA *items,int index,void *value);
+void **extractCDA(CDA *items);
+void reserveCDA(CDA *items,int cap);
+int sizeCDA(CDA *items);
+void visualizeCDA(FILE *,CDA *items);
+void displayCDA(FILE *,CDA *items);
+
+
+int main(int argc, char **argv) {
+    static struct option long_opts[] = {
+        { "preempt-bound", required_argument, 0, 'p' },
+        { "stats", no_argument, 0, 's' },
+        { "pipelined", no_argument, 0, 'P' },
+        { "overlap-bound", required_argument, 0, 'o' },
+        { "cgroup", required_argument, 0, 'c' },
+        { "charge", required_argument, 0, 'C' },
+        { "wait-for-tick", no_argument, 0, 'w' },
+        { "ring", optional_argument, 0, 'r' },
+        { "verbose", no_argument, 0, 'v' },
+        { "yield", optional_argument, 0, 'y' },
+        { "log-dir", required_argument, 0, 'L' },
+        { "log-by", required_argument, 0, 'B' },
+        { "log-size", required_argument, 0, 'S' },
+        { "trace", required_argument, 0, 't' },
+        { "trace-policy", required_argument, 0, 'T' },
+        { "socket", required_argument, 0, 'u' },
+        { "simulate", no_argument, 0, 'n' },
+        { "fibers", no_argument, 0, 'F' },
+        { "sweep", required_argument, 0, 'W' },
+        { "threads", required_argument, 0, 'j' },
+        { "policy", required_argument, 0, 'm' },
+        { "edf-bound", required_argument, 0, 'U' },
+        { "admission", required_argument, 0, 'A' },
+        { "critical-path", no_argument, 0, 'k' },
+        { "restore", required_argument, 0, 'R' },
+        { "queue-limit", required_argument, 0, 'q' },
+        { "overflow", required_argument, 0, 'O' },
+        { "affinity", optional_argument, 0, 'a' },
+        { "low-jitter", optional_argument, 0, 'J' },
+        { 0, 0, 0, 0 }
+    };
+    int opt, i;
+    while ((opt = getopt_long(argc, argv, "p:sPo:c:C:wr::vy::L:B:S:t:T:u:nFW:j:m:U:A:kR:q:O:a::J::", long_opts, 0)) != -1) {
+        switch (opt) {
+        case 'p':
+            opts.preempt_bound_ms = atoi(optarg);
+            break;
+        case 's':
+            opts.stats = 1;
+            break;
+        case 'P':
+            opts.pipelined = 1;
+            break;
+        case 'o':
+            opts.overlap_bound_ms = atoi(optarg);
+            break;
+        case 'c':
+            opts.cgroup = optarg;
+            break;
+        case 'C':
+            if (strcmp(optarg, "cpu") == 0) {
+                opts.charge_cpu = 1;
+            } else if (strcmp(optarg, "ticks") != 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'w':
+            opts.wait_for_tick = 1;
+            break;
+        case 'r':
+            opts.ring_slots = optarg ? atoi(optarg) : DEFAULT_RING_SLOTS;
+            if (opts.ring_slots <= 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'v':
+            opts.verbose = 1;
+            break;
+        case 'L':
+            opts.log_dir = optarg;
+            break;
+        case 'B':
+            if (strcmp(optarg, "level") == 0) {
+                opts.log_by_level = 1;
+            } else if (strcmp(optarg, "job") != 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'S':
+            opts.log_size_kb = atoi(optarg);
+            break;
+        case 't':
+            opts.trace_file = optarg;
+            break;
+        case 'u':
+            opts.socket_path = optarg;
+            break;
+        case 'n':
+            opts.simulate = 1;
+            break;
+        case 'F':
+            opts.fibers = 1;
+            break;
+        case 'W':
+            opts.sweep = optarg;
+            break;
+        case 'j':
+            opts.threads = atoi(optarg);
+            if (opts.threads <= 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'm':
+            opts.policy = optarg;
+            break;
+        case 'U':
+            opts.edf_bound = atoi(optarg);
+            break;
+        case 'k':
+            opts.critical_path = 1;
+            break;
+        case 'R':
+            opts.restore = optarg;
+            break;
+        case 'q': {
+            int *l = opts.queue_limits, len = 0;
+            int got = sscanf(optarg, "%d,%d,%d,%d%n", &l[0], &l[1], &l[2], &l[3], &len);
+            if (got == 1) {
+                l[1] = l[2] = l[3] = l[0];
+            } else if (got != 4 || optarg[len] != '\0') {
+                usage();
+                return 1;
+            }
+            break;
+        }
+        case 'a':
+            opts.affinity = optarg ? atoi(optarg) : DEFAULT_AFFINITY_IMBALANCE;
+            if (opts.affinity <= 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'J':
+            opts.low_jitter = optarg ? atoi(optarg) : DEFAULT_FIFO_PRIORITY;
+            if (opts.low_jitter < sched_get_priority_min(SCHED_FIFO)
+                || opts.low_jitter > sched_get_priority_max(SCHED_FIFO)) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'O':
+            if (strcmp(optarg, "spill") == 0) {
+                opts.overflow = OVERFLOW_SPILL;
+            } else if (strcmp(optarg, "reject") == 0) {
+                opts.overflow = OVERFLOW_REJECT;
+            } else if (strcmp(optarg, "defer") != 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'A':
+            if (strcmp(optarg, "reject") == 0) {
+                opts.edf_reject = 1;
+            } else if (strcmp(optarg, "downgrade") != 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'T':
+            if (strcmp(optarg, "block") == 0) {
+                opts.trace_policy = TRACE_BLOCK;
+            } else if (strcmp(optarg, "drop") != 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'y':
+            opts.yield_timeout_ms = optarg ? atoi(optarg) : DEFAULT_YIELD_TIMEOUT_MS;
+            if (opts.yield_timeout_ms <= 0) {
+                usage();
+                return 1;
+            }
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind < argc - 1 || (optind == argc && !opts.socket_path && !opts.restore)
+        || opts.preempt_bound_ms < 0 || opts.overlap_bound_ms < 0 || opts.log_size_kb < 0
+        || opts.edf_bound < 0 || opts.queue_limits[0] < 0 || opts.queue_limits[1] < 0
+        || opts.queue_limits[2] < 0 || opts.queue_limits[3] < 0
+        || ((opts.simulate || opts.fibers || opts.sweep) && (opts.socket_path || opts.restore))
+        || (opts.restore && optind < argc)) {
+        usage();
+        return 1;
+    }
+    restart_argv = argv;
+    restart_argc = optind;
+    for (job_policy = 0, i = 0; policies[i]; i++) {
+        if (strcmp(policies[i]->name, opts.policy) == 0) {
+            job_policy = policies[i];
+        }
+    }
+    if (!job_policy) {
+        usage();
+        return 1;
+    }
+    if (opts.simulate) {
+        job_backend = &sim_backend;
+    } else if (opts.fibers) {
+        job_backend = &fiber_backend;
+    }
+    if (job_backend->virtual_clock) {
+        // no processes are run, so there is nothing to control, capture or
+        // wait for; and no deadline is missed by holding up for the trace
+        opts.pipelined = 0;
+        opts.cgroup = 0;
+        opts.charge_cpu = 0;
+        opts.ring_slots = opts.yield_timeout_ms = 0;
+        opts.affinity = 0;
+        opts.low_jitter = 0;
+        opts.log_dir = 0;
+        opts.trace_policy = TRACE_BLOCK;
+    }
+    if (opts.low_jitter && opts.trace_policy == TRACE_BLOCK) {
+        // the writer threads keep the normal policy, and a tick held up
+        // for them is held up behind everything else on its CPU
+        fprintf(stderr, "--trace-policy=block would hold the SCHED_FIFO ticks up behind the"
+                " trace writer; records are dropped instead.\n");
+        opts.trace_policy = TRACE_DROP;
+    }
+    
+    FILE *dispatch_file = optind < argc ? fopen(argv[optind], "r") : 0;
+    
+    if (optind < argc && !dispatch_file) {
+        fprintf(stderr, "can't open %s as dispatch_list.\n", argv[optind]);
+        return 1;
+    }
+    
+    dispatcher d = { 0 };
+    d.dispatch_queue = newCDA(display_proc);
+    d.timers = newWHEEL(0);
+    d.rq = malloc(sizeof(CDA *) * 4);
+    
+    // sized up front and never shrunk, so that ticks don't allocate
+    for (int i = 0; i < 4; i++) {
+        d.rq[i] = newCDA(display_proc);
+        reserveCDA(d.rq[i], QUEUE_RESERVE);
+        d.ready[i].compare = compare_remaining;
+        heap_reserve(&d.ready[i], QUEUE_RESERVE);
+        d.deferred[i] = newCDA(display_proc);
+        reserveCDA(d.deferred[i], QUEUE_RESERVE);
+    }    
+    d.edf.compare = compare_deadlines;
+    heap_reserve(&d.edf, QUEUE_RESERVE);
+    commands = newCOMMANDS();
+    default_command = internCOMMANDS(commands, opts.fibers ? DEFAULT_FIBER_COMMAND
+                                                           : DEFAULT_COMMAND);
+    char line_buf[BUF_SIZE];
+    if (opts.restore && restore(&d, opts.restore) < 0) {
+        return 1;
+    }
+    
+    while (dispatch_file && fgets(line_buf, BUF_SIZE, dispatch_file)) {
+        double arrival_time, deadline = -1;
+        int priority, proc_time, len = 0; 
+        const int got = sscanf(line_buf, "%lf,%d,%d%n", &arrival_time, &priority, &proc_time, &len);
+        const COMMAND *cmd = default_command;
+        const char *deps = 0;
+        if (got == 3 && line_buf[len] == ',') {
+            const char *rest = parse_fields(line_buf + len + 1, &deadline, &deps);
+            if (rest) {
+                cmd = internCOMMANDS(commands, rest);
+            }
+        }
+        process *proc = 0;
+        if (got == 3 && arrival_time >= 0 && priority >= 0 && priority <= 3 && cmd
+            && (deadline > 0 || deadline == -1)) {
+            proc = new_proc(arrival_time, priority, proc_time);
+            proc->id = sizeCDA(d.dispatch_queue);
+        }
+        if (!proc || (deps && add_dependencies(&d, proc, deps) < 0)) {
+            fprintf(stderr, "error parsing file.\n");
+            return 1;
+        }
+        proc->cmd = cmd;
+        if (deadline > 0) {
+            proc->deadline_us = proc->arrival_us + (int64_t)(deadline * USEC_PER_SEC);
+        }
+        insertCDAback(d.dispatch_queue, proc);
+        // one with dependencies goes on the heap once they have finished
+        if (proc->waiting_on == 0) {
+            add_arrival(&d, proc);
+        }
+    }
+    if (opts.critical_path && !opts.restore) {
+        mark_critical_paths(&d);
+    }
+    
+    if (opts.sweep) {
+        return run_sweep(&d);
+    }
+
+
+    if (opts.cgroup) {
+        snprintf(line_buf, BUF_SIZE, "dispatcher.%d", (int)getpid());
+        run_cg = newCGROUP(opts.cgroup, line_buf);
+        if (!run_cg) {
+            fprintf(stderr, "can't use cgroup %s/%s (%s); using process groups.\n",
+                    opts.cgroup, line_buf, strerror(errno));
+        }
+    }
+
+    if (opts.affinity) {
+        sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus);
+        num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+        if (num_cpus > CPU_SETSIZE) {
+            num_cpus = CPU_SETSIZE;
+        }
+        cpu_homes = calloc(num_cpus, sizeof(int));
+        assert(cpu_homes != 0);
+    }
+
+    if (opts.yield_timeout_ms && !opts.ring_slots) {
+        opts.ring_slots = DEFAULT_RING_SLOTS;
+    }
+    if (opts.ring_slots) {
+        ring = newJOBSHM(opts.ring_slots);
+        if (ring) {
+            snprintf(line_buf, BUF_SIZE, "%d", fdJOBSHM(ring));
+            setenv(JOBSHM_FD_ENV, line_buf, 1);
+        } else {
+            fprintf(stderr, "can't create the event ring (%s); using stdout.\n",
+                    strerror(errno));
+        }
+    }
+
+    if (opts.verbose || (opts.trace_file && strcmp(opts.trace_file, "-") == 0)) {
+        out = newTRACER(STDOUT_FILENO, TRACE_BUFFER, opts.trace_policy);
+        tracer = opts.trace_file ? out : 0;
+    }
+    if (opts.trace_file && !tracer) {
+        // a restored dispatcher carries on the trace of the one before
+        int fd = open(opts.trace_file, O_WRONLY | O_CREAT | O_CLOEXEC
+                                       | (opts.restore ? O_APPEND : O_TRUNC), 0644);
+        if (fd < 0) {
+            fprintf(stderr, "can't open %s as trace.\n", opts.trace_file);
+            return 1;
+        }
+        tracer = newTRACER(fd, TRACE_BUFFER, opts.trace_policy);
+    }
+
+    // the environment is final now, so every command's envp can be built
+    sealCOMMANDS(commands, environ);
+    stopping = newDA(display_proc);
+    capturing = newDA(display_proc);
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, 0);
+    chld_fd = signalfd(-1, &chld_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (opts.socket_path) {
+        control = newCONTROL(opts.socket_path, sizeCDA(d.dispatch_queue));
+        if (!control) {
+            fprintf(stderr, "can't listen on %s (%s).\n", opts.socket_path, strerror(errno));
+            return 1;
+        }
+        accepting = !opts.restore || restored_accepting;
+    }
+    // a restored dispatcher picks up at the top of the tick it stopped at
+    epoch_us = now_us() - (int64_t)d.curr_time * TICK_US;
+    clock_epoch_us = clock_us() - (int64_t)d.curr_time * TICK_US;
+    if (opts.restore) {
+        adopt_processes(&d);
+    }
+    if (opts.low_jitter) {
+        enter_low_jitter();
+    }
+    int64_t loop_start_ns = cpu_ns();
+    long long allocs = alloc_count ? alloc_count() : 0;
+    stats.startup_allocs = allocs;
+    while (accepting || d.currently_running
+           || d.num_procs_processed != sizeCDA(d.dispatch_queue)) {
+        if (control) {
+            take_requests(&d);
+        }
+        admit_arrivals(&d, (int64_t)d.curr_time * TICK_US);
+        if (d.currently_running && opts.charge_cpu) {
+            charge_cpu(d.currently_running);
+        }
+        if (d.currently_running && (d.currently_running->proc_time == 0
+                                    || d.currently_running->state == finished)) {
+            terminateProcess(d.currently_running);
+            leave_cpu(&d);
+        } 
+      
+        dispatch(&d);
+        trace_tick(&d);
+        note_depths(&d, 1);
+        // decrement proc_time
+        if (d.currently_running) {
+            d.currently_running->ticks++;
+            if (!opts.charge_cpu) {
+                d.currently_running->proc_time--; 
+            }
+        }
+        d.curr_time++;
+        if (!accepting && !d.currently_running
+            && d.num_procs_processed == sizeCDA(d.dispatch_queue)) {
+            count_allocs(&allocs, d.curr_time - 1);
+            break;
+        }
+        job_backend->wait(&d, (int64_t)d.curr_time * TICK_US);
+        if (!job_backend->virtual_clock) {
+            note_lateness(elapsed_us() - (int64_t)d.curr_time * TICK_US);
+        }
+        count_allocs(&allocs, d.curr_time - 1);
+    }
+    stats.loop_cpu_ns += cpu_ns() - loop_start_ns;
+
+    if (ring) {
+        drain_events();
+    }
+    while (sizeDA(capturing) > 0) {
+        capture_output((process *)getDA(capturing, 0), 1);
+    }
+    for (int i = 0; i < 4; i++) {
+        if (level_logs[i]) {
+            freeJOBLOG(level_logs[i]);
+        }
+    }
+    if (control) {
+        freeCONTROL(control);
+    }
+    if (tracer && tracer != out) {
+        freeTRACER(tracer, &stats.trace);
+    }
+    if (out) {
+        freeTRACER(out, tracer == out ? &stats.trace : &stats.out);
+    }
+    if (opts.stats) {
+        print_stats(stderr, &d);
+    }
+    if (run_cg) {
+        freeCGROUP(run_cg);
+    }
+     
+    return 0;
+}
+
+void usage(void) {
+    printf("usage: ./dispatcher [options] [dispatch_list]\n"
+           "  -p, --preempt-bound=MS  check for arrivals every MS ms between ticks so a\n"
+           "                          system process starts within MS ms (default %d,\n"
+           "                          0 admits only on tick boundaries)\n"
+           "  -s, --stats             print a report to stderr on exit\n"
+           "  -P, --pipelined         start the next process while the previous one\n"
+           "                          is still stopping\n"
+           "  -o, --overlap-bound=MS  when pipelined, never let two processes run\n"
+           "                          together for more than MS ms (default %d)\n"
+           "  -c, --cgroup=DIR        start each process in its own cgroup under the\n"
+           "                          delegated cgroup v2 directory DIR and freeze\n"
+           "                          it instead of signalling it\n"
+           "  -C, --charge=ticks|cpu  charge processes one unit per tick held (default)\n"
+           "                          or per TIME_QUANTUM of CPU time actually used\n"
+           "  -w, --wait-for-tick     when a process exits early, leave the CPU idle\n"
+           "                          until the next tick instead of dispatching at once\n"
+           "  -r, --ring[=SLOTS]      have processes report ticks and signals through a\n"
+           "                          shared-memory ring instead of stdout (default %d\n"
+           "                          slots, one per live process)\n"
+           "  -v, --verbose           with --ring, print the reported events\n"
+           "  -J, --low-jitter[=PRIO] run the ticks at SCHED_FIFO priority PRIO\n"
+           "                          (default %d) with the dispatcher's memory\n"
+           "                          locked, where permitted, and report how late\n"
+           "                          each tick started as a histogram\n"
+           "  -a, --affinity[=N]      pin each process to a CPU, the one with fewest\n"
+           "                          processes pinned to it when it starts, and\n"
+           "                          resume it on the CPU it last ran on unless\n"
+           "                          that has N more pinned to it than another\n"
+           "                          (default %d)\n"
+           "  -y, --yield[=MS]        ask processes that report through the ring to\n"
+           "                          yield and park instead of sending SIGTSTP and\n"
+           "                          SIGCONT; signal any that hasn't parked within MS\n"
+           "                          ms (default %d). Implies --ring\n"
+           "  -L, --log-dir=DIR       capture the output of processes into logs in DIR\n"
+           "                          rather than passing on the dispatcher's stdout\n"
+           "  -B, --log-by=job|level  one log per process, job.ID.log (default), or per\n"
+           "                          starting priority, level.N.log\n"
+           "  -S, --log-size=KB       rotate a log to NAME.1 when it reaches KB kbytes\n"
+           "                          (default %d, 0 never rotates)\n"
+           "  -t, --trace=FILE        log each admission, scheduling decision and the\n"
+           "                          run queues at every tick to FILE (- for stdout)\n"
+           "  -T, --trace-policy=drop|block\n"
+           "                          when the trace or -v output falls behind, drop\n"
+           "                          records (default) or hold up the dispatcher,\n"
+           "                          which --low-jitter doesn't allow\n"
+           "  -u, --socket=PATH       take commands on the Unix socket PATH, one per\n"
+           "                          line: submit ARRIVAL,PRIORITY,PROC_TIME (ARRIVAL\n"
+           "                          may be +SECONDS from now), query, cancel ID,\n"
+           "                          checkpoint FILE, restart FILE (checkpoint, then\n"
+           "                          carry on from it in a fresh dispatcher with the\n"
+           "                          same pid) and shutdown. Runs until shut down; the\n"
+           "                          dispatch list is then optional\n"
+           "  -n, --simulate          start no processes: replay the dispatch list\n"
+           "                          against a virtual clock, every job using its whole\n"
+           "                          service time, with the same trace and report\n"
+           "  -F, --fibers            run each job as a fiber in the dispatcher, its\n"
+           "                          COMMAND naming a built-in task: spin [STEPS],\n"
+           "                          yield or count SLICES (default spin). A tick is\n"
+           "                          one slice, up to the task's next yield\n"
+           "  -W, --sweep=SPEC        simulate the dispatch list under every combination\n"
+           "                          of levels, quantum (ticks), aging (ticks waited\n"
+           "                          before moving up a level, 0 for none) and cpus in\n"
+           "                          SPEC, e.g. levels=3:4,quantum=1:2,cpus=1:2:4, and\n"
+           "                          print a table of the results\n"
+           "  -j, --threads=N         run N simulations of a sweep at once (default one\n"
+           "                          per CPU)\n"
+           "  -m, --policy=POLICY     schedule by mlfq, the four-level feedback queue\n"
+           "                          (default); rr, round robin over one queue\n"
+           "                          whatever the priority; fcfs, first come first\n"
+           "                          served; srtf, shortest remaining time first; or\n"
+           "                          mlfq-srtf, the feedback queue with each level\n"
+           "                          shortest remaining time first. srtf-scan and\n"
+           "                          mlfq-srtf-scan are the last two without heaps\n"
+           "  -U, --edf-bound=PERCENT admit processes with deadlines to the EDF tier,\n"
+           "                          which runs before anything else, earliest\n"
+           "                          deadline first, while the sum of their service\n"
+           "                          times over the time they are allowed is within\n"
+           "                          PERCENT of the CPU (default %d)\n"
+           "  -A, --admission=downgrade|reject\n"
+           "                          run a process that can't be admitted by the\n"
+           "                          EDF tier as if it had no deadline (default),\n"
+           "                          or never\n"
+           "  -k, --critical-path     admit processes on the longest chain of service\n"
+           "                          times through their dependencies at priority 1\n"
+           "  -R, --restore=FILE      resume from a snapshot written by the checkpoint\n"
+           "                          or restart command instead of a dispatch list,\n"
+           "                          taking back the processes it had started that\n"
+           "                          are still alive\n"
+           "  -q, --queue-limit=N[,N,N,N]\n"
+           "                          admit no process to a run queue holding N, for\n"
+           "                          every level or each in turn (default 0, no\n"
+           "                          limit). A policy with one queue uses the first\n"
+           "  -O, --overflow=defer|spill|reject\n"
+           "                          hold an arrival whose run queue is full back\n"
+           "                          until there is room (default), queue it at the\n"
+           "                          first lower level with room and otherwise hold\n"
+           "                          it back, or reject it\n"
+           "Each line of the dispatch list, or submission, is\n"
+           "  ARRIVAL,PRIORITY,PROC_TIME[,DEADLINE][,@ID ID ...][,COMMAND]\n"
+           "where DEADLINE is the seconds after ARRIVAL it must have finished by; IDs\n"
+           "are earlier lines, counting from 0, that must have finished before it can\n"
+           "start; and COMMAND is the program and its arguments, separated by spaces,\n"
+           "after any NAME=value settings for its environment (default %s).\n",
+           DEFAULT_PREEMPT_BOUND_MS, DEFAULT_OVERLAP_BOUND_MS, DEFAULT_RING_SLOTS,
+           DEFAULT_FIFO_PRIORITY, DEFAULT_AFFINITY_IMBALANCE,
+           DEFAULT_YIELD_TIMEOUT_MS, DEFAULT_LOG_SIZE_KB, DEFAULT_EDF_BOUND, DEFAULT_COMMAND);
+}
+
+// Returns the time in microseconds: the backend's virtual clock if it keeps
+// one, or the monotonic clock.
+
+int64_t now_us(void) {
+    if (job_backend->virtual_clock) {
+        return virtual_us;
+    }
+    return clock_us();
+}
+
+// Returns the monotonic clock in microseconds.
+
+int64_t clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+// Returns the CPU time the dispatcher has used in nanoseconds.
+
+int64_t cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Adds the heap allocations made since the count in *mark to the stats, as
+// made by the given tick, and moves the mark on. Allocations are only counted
+// with bench/alloccount.so preloaded.
+
+void count_allocs(long long *mark, int tick) {
+    if (!alloc_count) {
+        return;
+    }
+    long long now = alloc_count();
+    if (now > *mark) {
+        stats.tick_allocs += now - *mark;
+        stats.alloc_ticks++;
+        stats.last_alloc_tick = tick;
+    }
+    *mark = now;
+}
+
+// Adds how late a tick started, in microseconds after it was due, to the
+// histogram.
+
+void note_lateness(int64_t late) {
+    int bucket = late > 0 ? 64 - __builtin_clzll((uint64_t)late) : 0;
+    if (bucket >= LATE_BUCKETS) {
+        bucket = LATE_BUCKETS - 1;
+    }
+    stats.late_hist[bucket]++;
+    stats.late_ticks++;
+    if (late > 0) {
+        stats.late_us += late;
+    }
+    if (late > stats.max_late_us) {
+        stats.max_late_us = late;
+    }
+}
+
+// Sets the dispatcher up for --low-jitter, so that nothing but the host's
+// own real-time work can hold a tick up. The scheduling thread runs at
+// SCHED_FIFO, and the processes it forks go back to the normal policy. Its
+// timer slack is cut to the least there is, its memory is locked, freed
+// memory is kept rather than handed back to be faulted in again, and the
+// stack it will use is faulted in now. Whatever isn't permitted is reported
+// and done without. The writer and socket threads were started before, and
+// keep the normal policy.
+
+void enter_low_jitter(void) {
+    struct sched_param sp = { .sched_priority = opts.low_jitter };
+    stats.fifo = sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &sp) == 0;
+    if (!stats.fifo) {
+        fprintf(stderr, "can't run at SCHED_FIFO %d (%s); ticks stay at normal priority.\n",
+                opts.low_jitter, strerror(errno));
+    }
+    prctl(PR_SET_TIMERSLACK, 1);
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    stats.locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    if (!stats.locked) {
+        fprintf(stderr, "can't lock the dispatcher's memory (%s); pages may be faulted in"
+                " during ticks.\n", strerror(errno));
+    }
+    prefault_stack();
+}
+
+// Touches PREFAULT_STACK bytes of stack below the caller, so that the ticks
+// never have to fault a page of it in.
+
+void prefault_stack(void) {
+    volatile char stack[PREFAULT_STACK];
+    size_t i;
+    for (i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+// Returns the microseconds since tick 0 started.
+
+int64_t elapsed_us(void) {
+    return now_us() - epoch_us;
+}
+
+// Hands every pending process that has arrived by time t (microseconds
+// since tick 0) to the policy. Returns the number it wants to preempt for.
+
+int admit_arrivals(dispatcher *d, int64_t t) {
+    int urgent = 0;
+    int i;
+    // those held back arrived first, so they go first as there is room
+    for (i = 0; i < 4; i++) {
+        while (sizeCDA(d->deferred[i]) > 0
+               && room_for(d, (process *)getCDA(d->deferred[i], 0))) {
+            urgent += admit(d, (process *)removeCDAfront(d->deferred[i]));
+        }
+    }
+    TIMER *timer, *next;
+    for (timer = get_procs_with_arrival_time(d, t); timer; timer = next) {
+        next = timer->next;
+        urgent += admit(d, (process *)timer->data);
+    }
+    return urgent;
+}
+
+// Hands one process that has arrived to the EDF tier or the policy, unless
+// the run queue the policy would put it in is full and it is held back or
+// rejected instead. Returns 1 if it should preempt at once.
+
+int admit(dispatcher *d, process *p) {
+    if (p->critical && p->priority > 1) {
+        trace("boost job %d priority 1\n", p->id);
+        p->priority = 1;
+        stats.boosted++;
+    }
+    // the EDF tier has an admission test of its own
+    int to_policy = p->deadline_us < 0 || (!fits_edf(d, p) && !opts.edf_reject);
+    if (to_policy && !make_room(d, p)) {
+        // one shed lets go of the processes waiting on it
+        return p->state == finished ? release_dependents(d, p) : 0;
+    }
+    if (p->deferred) {
+        int64_t held = elapsed_us() - p->arrival_us;
+        stats.defer_us += held;
+        if (held > stats.max_defer_us) {
+            stats.max_defer_us = held;
+        }
+    }
+    d->num_procs_processed++;
+    trace("admit job %d priority %d\n", p->id, p->priority);
+    p->state = ready;
+    if (p->deadline_us >= 0) {
+        int urgent = admit_deadline(d, p);
+        if (p->state != finished) {
+            addWHEEL(d->timers, &p->deadline_timer, p->deadline_us);
+        }
+        return urgent;
+    }
+    int urgent = job_policy->on_arrival(d, p);
+    note_depths(d, 0);
+    return urgent;
+}
+
+// Puts a process with a deadline in the EDF tier if the densities of those
+// already there, service time over time allowed, leave room for its own
+// within the bound; the tier can then meet every deadline in it. Otherwise
+// it is rejected, or downgraded to be run by the policy like any other.
+// Returns 1 if it should preempt at once.
+
+int admit_deadline(dispatcher *d, process *p) {
+    double density = (double)p->service_time * TICK_US / (p->deadline_us - p->arrival_us);
+    if (fits_edf(d, p)) {
+        trace("edf job %d deadline %.3f\n", p->id, p->deadline_us / 1e6);
+        p->edf = 1;
+        p->density = density;
+        d->edf_load += density;
+        heap_push(&d->edf, p);
+        stats.edf_admitted++;
+        process *r = d->currently_running;
+        return !r || !r->edf || compare_deadlines(p, r) < 0;
+    }
+    if (opts.edf_reject) {
+        trace("reject job %d\n", p->id);
+        p->state = finished;
+        p->proc_time = 0;
+        stats.edf_rejected++;
+        return release_dependents(d, p);
+    }
+    trace("downgrade job %d\n", p->id);
+    stats.edf_downgraded++;
+    int urgent = job_policy->on_arrival(d, p);
+    note_depths(d, 0);
+    return urgent;
+}
+
+// Returns whether the EDF tier has room for a process with a deadline: the
+// densities of those already there, service time over time allowed, leave
+// room for its own within the bound.
+
+int fits_edf(dispatcher *d, process *p) {
+    double density = (double)p->service_time * TICK_US / (p->deadline_us - p->arrival_us);
+    // a little slack, so densities that add up to the bound exactly fit
+    return d->edf_load + density <= opts.edf_bound / 100.0 + 1e-9;
+}
+
+// Sees that the run queue a process is about to go in has room for it under
+// --queue-limit. If it is full the process is queued a level down when
+// spilling and one has room, shed when rejecting, and otherwise held back
+// until there is room; a system process spilled is run as an ordinary one.
+// Returns 1 if the process can be queued, at its priority as it now is, and
+// 0 if it was held back or shed, when it is left finished.
+
+int make_room(dispatcher *d, process *p) {
+    int level = queue_of(p);
+    if (!queue_full(d, level)) {
+        return 1;
+    }
+    if (opts.overflow == OVERFLOW_SPILL && job_policy->levels > 1) {
+        int lower;
+        for (lower = level + 1; lower < 4; lower++) {
+            if (!queue_full(d, lower)) {
+                trace("spill job %d priority %d\n", p->id, lower);
+                p->priority = lower;
+                stats.spilled++;
+                return 1;
+            }
+        }
+    }
+    if (opts.overflow == OVERFLOW_REJECT) {
+        trace("shed job %d\n", p->id);
+        d->num_procs_processed++;
+        p->state = finished;
+        p->proc_time = 0;
+        stats.shed++;
+        return 0;
+    }
+    if (!p->deferred) {
+        trace("defer job %d\n", p->id);
+        p->deferred = 1;
+        stats.deferred++;
+    }
+    insertCDAback(d->deferred[level], p);
+    int held = sizeCDA(d->deferred[0]) + sizeCDA(d->deferred[1]) + sizeCDA(d->deferred[2])
+               + sizeCDA(d->deferred[3]);
+    if (held > stats.max_deferred) {
+        stats.max_deferred = held;
+    }
+    return 0;
+}
+
+// Returns whether a process held back can be admitted now: its run queue,
+// or one below it when spilling, has room.
+
+int room_for(dispatcher *d, process *p) {
+    int level = queue_of(p);
+    int last = opts.overflow == OVERFLOW_SPILL && job_policy->levels > 1 ? 3 : level;
+    for (; level <= last; level++) {
+        if (!queue_full(d, level)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns the run queue the policy puts a process in.
+
+int queue_of(process *p) {
+    return job_policy->levels > 1 ? p->priority : 0;
+}
+
+// Returns whether a run queue has reached its limit.
+
+int queue_full(dispatcher *d, int level) {
+    int limit = opts.queue_limits[level];
+    return limit > 0 && queue_depth(d, level) >= limit;
+}
+
+// Returns the number of processes waiting in a run queue. A policy keeps its
+// queues as CDAs or as heaps, never both, so one of the two is empty.
+
+int queue_depth(dispatcher *d, int level) {
+    return sizeCDA(d->rq[level]) + d->ready[level].size;
+}
+
+// Raises the watermark of each run queue to its depth. At a tick the depths
+// also go towards the means.
+
+void note_depths(dispatcher *d, int tick) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        int depth = queue_depth(d, i);
+        if (depth > stats.queue_max[i]) {
+            stats.queue_max[i] = depth;
+        }
+        if (tick) {
+            stats.queue_sum[i] += depth;
+        }
+    }
+}
+
+// Returns the process to switch to, or 0 to leave the CPU as it is. The EDF
+// tier comes before anything the policy has: its earliest deadline runs,
+// preempting a later one, and otherwise the policy decides.
+
+process *pick(dispatcher *d, int expired) {
+    process *r = d->currently_running;
+    if (d->edf.size > 0 && (!r || !r->edf || compare_deadlines(d->edf.arr[0], r) < 0)) {
+        return heap_pop(&d->edf);
+    }
+    if (r && r->edf) {
+        return 0;
+    }
+    return job_policy->pick_next(d, expired);
+}
+
+// Queues a process being switched out where it came from.
+
+void requeue(dispatcher *d, process *p) {
+    if (p->edf) {
+        heap_push(&d->edf, p);
+    } else {
+        job_policy->on_quantum_expired(d, p);
+        note_depths(d, 0);
+    }
+}
+
+// Drops a process that has finished or been cancelled, running or not, and
+// lets go of the processes waiting on it. Returns 1 if one of those should
+// preempt at once.
+
+int forget(dispatcher *d, process *p) {
+    cancelWHEEL(d->timers, &p->deadline_timer);
+    if (p->edf) {
+        if (p->heap_index >= 0) {
+            heap_remove(&d->edf, p);
+        }
+        d->edf_load -= p->density;
+        p->density = 0;
+    } else {
+        job_policy->on_exit(d, p);
+    }
+    return release_dependents(d, p);
+}
+
+// Reads the ids after the '@' of a dispatch list line, separated by spaces,
+// and makes p wait on each of those processes that hasn't finished. Only
+// processes listed before p can be waited on, so there are never cycles.
+// Returns 0, or -1 if an id is not of such a process.
+
+int add_dependencies(dispatcher *d, process *p, const char *ids) {
+    const char *s = ids;
+    char *end;
+    for (;;) {
+        s += strspn(s, " \t");
+        if (*s == ',' || *s == '\0' || *s == '\n' || *s == '\r') {
+            return 0;
+        }
+        long id = strtol(s, &end, 10);
+        if (end == s || id < 0 || id >= p->id) {
+            return -1;
+        }
+        s = end;
+        process *dep = (process *)getCDA(d->dispatch_queue, id);
+        if (dep->state == finished) {
+            continue;
+        }
+        if (dep->num_dependents == dep->dependents_cap) {
+            dep->dependents_cap = dep->dependents_cap ? dep->dependents_cap * 2 : 4;
+            dep->dependents = realloc(dep->dependents, sizeof(process *) * dep->dependents_cap);
+            assert(dep->dependents != 0);
+        }
+        dep->dependents[dep->num_dependents++] = p;
+        p->waiting_on++;
+        stats.dependencies++;
+    }
+}
+
+// Counts down the processes waiting on p, which has finished or been
+// cancelled. One with nothing left to wait on is admitted there and then if
+// it has arrived, so the CPU takes it at the next decision, and otherwise
+// goes on the arrival heap. Returns 1 if one admitted should preempt at
+// once, as an arrival would.
+
+int release_dependents(dispatcher *d, process *p) {
+    int urgent = 0;
+    int i;
+    for (i = 0; i < p->num_dependents; i++) {
+        process *q = p->dependents[i];
+        if (--q->waiting_on > 0 || q->state != pending) {
+            continue;
+        }
+        if (q->arrival_us <= elapsed_us()) {
+            stats.held++;
+            urgent |= admit(d, q);
+        } else {
+            add_arrival(d, q);
+        }
+    }
+    p->num_dependents = 0;
+    return urgent;
+}
+
+// Marks the processes on the critical path of each dependency graph: those
+// for which the longest chain of service times through them, from a process
+// waiting on nothing to one nothing waits on, is as long as any in their
+// graph. Arrival times are left out. Dependencies only point back up the
+// list, so one pass each way finds the longest chain into and out of every
+// process, and a union-find pass which graph it is in.
+
+void mark_critical_paths(dispatcher *d) {
+    int n = sizeCDA(d->dispatch_queue);
+    int64_t *into = calloc(n, sizeof(int64_t)); // Longest chain before it
+    int64_t *from = calloc(n, sizeof(int64_t)); // Longest chain from it on
+    int64_t *longest = calloc(n, sizeof(int64_t)); // Per graph, at its root
+    int *parent = malloc(sizeof(int) * n);
+    assert(into && from && longest && parent);
+    int i, j;
+    for (i = 0; i < n; i++) {
+        parent[i] = i;
+    }
+    for (i = 0; i < n; i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        for (j = 0; j < p->num_dependents; j++) {
+            process *q = p->dependents[j];
+            if (into[q->id] < into[i] + p->service_time) {
+                into[q->id] = into[i] + p->service_time;
+            }
+            parent[find_root(parent, q->id)] = find_root(parent, i);
+        }
+    }
+    for (i = n - 1; i >= 0; i--) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        for (j = 0; j < p->num_dependents; j++) {
+            if (from[i] < from[p->dependents[j]->id]) {
+                from[i] = from[p->dependents[j]->id];
+            }
+        }
+        from[i] += p->service_time;
+        int root = find_root(parent, i);
+        if (longest[root] < into[i] + from[i]) {
+            longest[root] = into[i] + from[i];
+        }
+    }
+    for (i = 0; i < n; i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        // a process on its own is in no graph
+        p->critical = (p->waiting_on > 0 || p->num_dependents > 0)
+                      && into[i] + from[i] == longest[find_root(parent, i)];
+    }
+    free(into);
+    free(from);
+    free(longest);
+    free(parent);
+}
+
+// Returns the root of i's set in parent, halving the path as it goes.
+
+int find_root(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Asks what runs for the next tick, the running process's quantum having
+// expired, and switches to it.
+
+void dispatch(dispatcher *d) {
+    process *next = pick(d, 1);
+    if (next) {
+        switch_to(d, next);
+    }
+}
+
+// The same between ticks, after an arrival asked to preempt: the running
+// process's quantum has not expired, unless the CPU is idle.
+
+void preempt(dispatcher *d) {
+    process *next = pick(d, d->currently_running == 0);
+    if (next) {
+        switch_to(d, next);
+    }
+}
+
+// Suspends the running process, if any, and queues it again, then starts or
+// resumes next. Between ticks the running process may already
+// have used up its time; it is terminated rather than requeued, and a
+// process waiting on it that should preempt then replaces next.
+
+void switch_to(dispatcher *d, process *next) {
+    int64_t t = elapsed_us();
+    process *prev = d->currently_running;
+    int urgent = 0;
+    if (prev && prev->proc_time == 0) {
+        terminateProcess(prev);
+        urgent = leave_cpu(d);
+        prev = 0;
+    }
+    if (prev) {
+        requeue(d, prev);
+        suspendProcess(prev);
+    }
+    if (next->state == ready) {
+        startProcess(next);
+    } else {
+        restartProcess(next);
+    }
+    d->currently_running = next;
+    if (prev) {
+        stats.switches++;
+        stats.switch_us += elapsed_us() - t;
+        if (prev->parked) {
+            stats.yield_switches++;
+            stats.yield_switch_us += elapsed_us() - t;
+        }
+    }
+    if (urgent) {
+        preempt(d);
+    }
+}
+
+// Takes the running process, which has finished or been cancelled, off the
+// CPU. Returns 1 if a process waiting on it should preempt at once; the
+// callers that don't dispatch straight after see to it.
+
+int leave_cpu(dispatcher *d) {
+    int urgent = forget(d, d->currently_running);
+    d->currently_running = 0;
+    return urgent;
+}
+
+// The four-level feedback queue, the default policy. rq[0] holds system
+// processes, which preempt anything but another system process and run to
+// completion; only the EDF tier can switch one out, and it goes back to the
+// front. The others are round-robin levels a process drops a level of each
+// time it is switched out, down to rq[3]; whatever waits at them replaces
+// the running process at each tick.
+
+int mlfq_arrival(dispatcher *d, process *p) {
+    insertCDAback(d->rq[p->priority], p);
+    return p->priority == 0;
+}
+
+process *mlfq_pick(dispatcher *d, int expired) {
+    process *r = d->currently_running;
+    int sys_running = r && r->priority == 0;
+    if (sizeCDA(d->rq[0]) > 0 && !sys_running) {
+        return (process *)removeCDAfront(d->rq[0]);
+    }
+    if (sys_running || !expired) {
+        return 0;
+    }
+    int i;
+    for (i = 1; i < 4; i++) {
+        if (sizeCDA(d->rq[i]) > 0) {
+            return (process *)removeCDAfront(d->rq[i]);
+        }
+    }
+    return 0;
+}
+
+void mlfq_expired(dispatcher *d, process *p) {
+    if (p->priority == 0) {
+        insertCDAfront(d->rq[0], p);
+        return;
+    }
+    if (p->priority != 3) {
+        p->priority++;
+    }
+    insertCDAback(d->rq[p->priority], p);
+}
+
+void mlfq_exit(dispatcher *d, process *p) {
+    if (p != d->currently_running) {
+        remove_from_queue(d->rq[p->priority], p);
+    }
+}
+
+// Plain round robin over a single queue, rq[0], whatever the priority, and
+// first come first served, which runs each process to completion. Neither
+// ever preempts between ticks. They are there to measure the others against.
+
+int rr_arrival(dispatcher *d, process *p) {
+    insertCDAback(d->rq[0], p);
+    return 0;
+}
+
+process *rr_pick(dispatcher *d, int expired) {
+    if (sizeCDA(d->rq[0]) == 0 || (d->currently_running && !expired)) {
+        return 0;
+    }
+    return (process *)removeCDAfront(d->rq[0]);
+}
+
+process *fcfs_pick(dispatcher *d, int expired) {
+    if (sizeCDA(d->rq[0]) == 0 || d->currently_running) {
+        return 0;
+    }
+    return (process *)removeCDAfront(d->rq[0]);
+}
+
+void rr_expired(dispatcher *d, process *p) {
+    insertCDAback(d->rq[0], p);
+}
+
+void rr_exit(dispatcher *d, process *p) {
+    if (p != d->currently_running) {
+        remove_from_queue(d->rq[0], p);
+    }
+}
+
+// Shortest remaining time first, over one heap whatever the priority: an
+// arrival preempts at once if it needs less time than the running process
+// has left, and is otherwise held until the CPU is free. As proc_time only
+// goes down while a process runs, and a running process is not on the heap,
+// no key changes in place; each decision is O(log n).
+
+int srtf_arrival(dispatcher *d, process *p) {
+    heap_push(&d->ready[0], p);
+    return d->currently_running && p->proc_time < d->currently_running->proc_time;
+}
+
+process *srtf_pick(dispatcher *d, int expired) {
+    heap *h = &d->ready[0];
+    if (h->size == 0
+        || (d->currently_running && h->arr[0]->proc_time >= d->currently_running->proc_time)) {
+        return 0;
+    }
+    return heap_pop(h);
+}
+
+void srtf_expired(dispatcher *d, process *p) {
+    heap_push(&d->ready[0], p);
+}
+
+void srtf_exit(dispatcher *d, process *p) {
+    if (p->heap_index >= 0) {
+        heap_remove(&d->ready[0], p);
+    }
+}
+
+// The four-level feedback queue with each level a heap on remaining time
+// rather than a queue in order of arrival. System processes still preempt
+// and run to completion, and processes still drop a level when switched out.
+
+int mlfq_srtf_arrival(dispatcher *d, process *p) {
+    heap_push(&d->ready[p->priority], p);
+    return p->priority == 0;
+}
+
+process *mlfq_srtf_pick(dispatcher *d, int expired) {
+    process *r = d->currently_running;
+    int sys_running = r && r->priority == 0;
+    if (d->ready[0].size > 0 && !sys_running) {
+        return heap_pop(&d->ready[0]);
+    }
+    if (sys_running || !expired) {
+        return 0;
+    }
+    int i;
+    for (i = 1; i < 4; i++) {
+        if (d->ready[i].size > 0) {
+            return heap_pop(&d->ready[i]);
+        }
+    }
+    return 0;
+}
+
+void mlfq_srtf_expired(dispatcher *d, process *p) {
+    if (p->priority != 0 && p->priority != 3) {
+        p->priority++;
+    }
+    heap_push(&d->ready[p->priority], p);
+}
+
+void mlfq_srtf_exit(dispatcher *d, process *p) {
+    if (p->heap_index >= 0) {
+        heap_remove(&d->ready[p->priority], p);
+    }
+}
+
+// The same two policies by rescanning the run queues for the shortest
+// process at every decision, O(n) each. They are the reference the heaps are
+// checked against: on any dispatch list each makes exactly the decisions of
+// its heap version.
+
+int scan_arrival(dispatcher *d, process *p) {
+    insertCDAback(d->rq[0], p);
+    return d->currently_running && p->proc_time < d->currently_running->proc_time;
+}
+
+process *scan_pick(dispatcher *d, int expired) {
+    process *p = shortest_in_queue(d->rq[0]);
+    if (!p || (d->currently_running && p->proc_time >= d->currently_running->proc_time)) {
+        return 0;
+    }
+    remove_from_queue(d->rq[0], p);
+    return p;
+}
+
+process *mlfq_scan_pick(dispatcher *d, int expired) {
+    process *r = d->currently_running;
+    int sys_running = r && r->priority == 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        if (sizeCDA(d->rq[i]) == 0) {
+            continue;
+        }
+        if (sys_running || (i > 0 && !expired)) {
+            return 0;
+        }
+        process *p = shortest_in_queue(d->rq[i]);
+        remove_from_queue(d->rq[i], p);
+        return p;
+    }
+    return 0;
+}
+
+// Returns the process in q with the least remaining time, the first listed
+// of those with the same, or 0 if q is empty.
+
+process *shortest_in_queue(CDA *q) {
+    process *best = 0;
+    int i;
+    for (i = 0; i < sizeCDA(q); i++) {
+        process *p = (process *)getCDA(q, i);
+        if (!best || compare_remaining(p, best) < 0) {
+            best = p;
+        }
+    }
+    return best;
+}
+
+// Collects the stop reports of processes suspended while pipelined. One that
+// has not stopped within the overlap bound is waited for with the running
+// process held by SIGSTOP, so the two never run together past the bound.
+
+void confirm_stops(dispatcher *d) {
+    int64_t bound_us = (int64_t)opts.overlap_bound_ms * 1000;
+    int i = 0;
+    while (i < sizeDA(stopping)) {
+        process *p = (process *)getDA(stopping, i);
+        int stopped = wait_stopped(p, 0);
+        if (!stopped && elapsed_us() - p->stop_us < bound_us) {
+            i++;
+            continue;
+        }
+        if (!stopped) {
+            process *r = d->currently_running;
+            int hold = r && r->stop_us < 0 && !r->exited;
+            if (hold) {
+                kill(-r->pid, SIGSTOP);
+                wait_child(r, WUNTRACED);
+            }
+            wait_stopped(p, 1);
+            // one that exited instead of stopping is reaped at the next check
+            if (hold && !r->exited) {
+                kill(-r->pid, SIGCONT);
+            }
+            stats.safeguards++;
+        }
+        int64_t overlap = elapsed_us() - p->stop_us;
+        if (overlap > stats.max_overlap_us) {
+            stats.max_overlap_us = overlap;
+        }
+        stats.stops++;
+        stats.stop_us += overlap;
+        p->stop_us = -1;
+        setDA(stopping, i, getDA(stopping, sizeDA(stopping) - 1));
+        removeDA(stopping);
+    }
+}
+
+// Waits for a single pipelined suspension to take effect, e.g. before the
+// process is resumed; a SIGCONT that overtook the stop would be lost.
+
+void confirm_stop(process *p) {
+    int i;
+    for (i = 0; i < sizeDA(stopping); i++) {
+        if (getDA(stopping, i) == p) {
+            break;
+        }
+    }
+    assert(i < sizeDA(stopping));
+    wait_stopped(p, 1);
+    stats.stops++;
+    stats.stop_us += elapsed_us() - p->stop_us;
+    p->stop_us = -1;
+    setDA(stopping, i, getDA(stopping, sizeDA(stopping) - 1));
+    removeDA(stopping);
+}
+
+// Returns the time by which the oldest pending stop must be confirmed, or -1
+// if there is none.
+
+int64_t next_stop_deadline(void) {
+    int64_t deadline = -1;
+    int i;
+    for (i = 0; i < sizeDA(stopping); i++) {
+        process *p = (process *)getDA(stopping, i);
+        if (deadline < 0 || p->stop_us < deadline) {
+            deadline = p->stop_us;
+        }
+    }
+    return deadline < 0 ? -1 : deadline + (int64_t)opts.overlap_bound_ms * 1000;
+}
+
+// Returns whether a suspended process has stopped (or been frozen), waiting
+// until it has if block is set. One that exited instead counts as stopped:
+// it won't run again, and its exit is collected for reap_process.
+
+int wait_stopped(process *p, int block) {
+    if (p->cg && !p->sigstopped) {
+        int frozen = frozenCGROUP(p->cg, block ? -1 : 0);
+        if (frozen >= 0) {
+            return frozen;
+        }
+        // with cgroup.events unreadable, the freeze is swapped for a
+        // SIGSTOP, which can be waited for; a frozen task wouldn't take it
+        thawCGROUP(p->cg);
+        kill(-p->pid, SIGSTOP);
+        p->sigstopped = 1;
+    }
+    // an adopted process can't be waited for; /proc shows when it stops
+    while (p->adopted) {
+        int state = sample_cpu(p);
+        if (state == 'T' || state == 't' || state == 'Z' || state == 'X' || state == 0) {
+            return 1;
+        }
+        if (!block) {
+            return 0;
+        }
+        usleep(1000);
+    }
+    if (p->exited) {
+        return 1;
+    }
+    return wait_child(p, WUNTRACED | (block ? 0 : WNOHANG)) != 0;
+}
+
+// Collects the exit status of the process, waiting for it if block is set,
+// and releases what was held for it. Its pid is never signalled again.
+// Returns 1 if the process has exited, 0 if it is still alive.
+
+int reap_process(process *p, int block) {
+    if (p->adopted) {
+        // init reaps it, and has its CPU time
+        if (!adopted_exited(p, block)) {
+            return 0;
+        }
+    } else if (!p->exited) {
+        wait_child(p, block ? 0 : WNOHANG);
+        if (!p->exited) {
+            return 0;
+        }
+    }
+    end_run(p);
+    if (p->end_us < 0) {
+        p->end_us = elapsed_us();
+    }
+    p->state = finished;
+    p->proc_time = 0;
+    if (p->stat_fd >= 0) {
+        close(p->stat_fd);
+        p->stat_fd = -1;
+    }
+    if (p->pidfd >= 0) {
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+    if (p->home >= 0) {
+        cpu_homes[p->home]--;
+        p->home = -1;
+    }
+    if (p->cg) {
+        sample_cpu(p);
+        freeCGROUP(p->cg);
+        p->cg = 0;
+    }
+    if (p->slot) {
+        drain_events();
+        stats.events_dropped += droppedJOBSLOT(p->slot);
+        releaseJOBSLOT(p->slot);
+        p->slot = 0;
+    }
+    return 1;
+}
+
+// Waits for the process to change state, as waitpid does with options. If
+// it has exited, its CPU time and the time it ended are kept and it is
+// marked exited, wherever it was waited for. Returns what wait4 does.
+
+pid_t wait_child(process *p, int options) {
+    int status;
+    struct rusage ru;
+    pid_t got = wait4(p->pid, &status, options, &ru);
+    if (got == p->pid && (WIFEXITED(status) || WIFSIGNALED(status))) {
+        int64_t cpu = (int64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * USEC_PER_SEC
+                      + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+        if (cpu > p->cpu_us) {
+            p->cpu_us = cpu;
+        }
+        if (p->end_us < 0) {
+            p->end_us = elapsed_us();
+        }
+        p->exited = 1;
+    }
+    return got;
+}
+
+// Adds the time since the process last started or resumed to the time the
+// CPU was busy.
+
+void end_run(process *p) {
+    if (p->resumed_us >= 0) {
+        // against a virtual clock, a process uses all of the CPU it is given
+        if (job_backend->virtual_clock) {
+            p->cpu_us += elapsed_us() - p->resumed_us;
+        }
+        stats.busy_us += elapsed_us() - p->resumed_us;
+        p->resumed_us = -1;
+    }
+}
+
+// Reads the CPU time the process has used so far into p->cpu_us: from its
+// cgroup if it has one, which counts every process in the tree, otherwise
+// from /proc/<pid>/stat, which counts the process and its reaped children.
+// Returns the state letter from /proc (e.g. 'Z' once the process has exited),
+// or 0 if it wasn't read.
+
+int sample_cpu(process *p) {
+    if (p->cg) {
+        long long usage = cpuCGROUP(p->cg);
+        if (usage > p->cpu_us) {
+            p->cpu_us = usage;
+        }
+    }
+    if (p->stat_fd < 0) {
+        return 0;
+    }
+    char buf[BUF_SIZE];
+    ssize_t n = pread(p->stat_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        return 0;
+    }
+    buf[n] = '\0';
+    // the command name in parentheses may itself contain spaces or ')'
+    char *fields = strrchr(buf, ')');
+    char state;
+    unsigned long utime, stime;
+    long cutime, cstime;
+    int processor = -1;
+    if (!fields || sscanf(fields + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld"
+                          " %*d %*d %*d %*d %*u %*u %*d %*u %*u %*u %*u %*u %*u %*u %*u %*u"
+                          " %*u %*u %*u %*u %*d %d", &state, &utime, &stime, &cutime,
+                          &cstime, &processor) < 5) {
+        return 0;
+    }
+    // where it is running, or ran last if it isn't
+    if (processor >= 0) {
+        if (p->last_cpu >= 0 && processor != p->last_cpu) {
+            stats.migrations++;
+        }
+        p->last_cpu = processor;
+    }
+    int64_t cpu = (int64_t)(utime + stime + cutime + cstime) * USEC_PER_SEC / sysconf(_SC_CLK_TCK);
+    if (cpu > p->cpu_us) {
+        p->cpu_us = cpu;
+    }
+    return state;
+}
+
+// Sets the running process's proc_time to its service time less the CPU time
+// it has used, rounded to whole quanta since a busy process gets slightly less
+// than a full quantum per tick. A process that has exited is charged in full.
+
+void charge_cpu(process *p) {
+    if (p->state == finished) {
+        return;
+    }
+    int state = sample_cpu(p);
+    int used = (int)((p->cpu_us + TICK_US / 2) / TICK_US);
+    p->proc_time = used < p->service_time ? p->service_time - used : 0;
+    if (state == 'Z' || state == 'X') {
+        p->proc_time = 0;
+    }
+}
+
+// Sleeps until tick_end (microseconds since tick 0). Unless the preempt bound
+// is 0, wakes every preempt_bound_ms to admit processes whose arrival time has
+// passed, and preempts for a system process then rather than at tick_end.
+// SIGCHLD also wakes it, to confirm pipelined stops as they happen, and so
+// does the running process's pidfd when it exits; unless waiting for the tick,
+// the next process is dispatched straight away. A process started between
+// ticks is first charged at the next tick.
+
+void wait_for_tick(dispatcher *d, int64_t tick_end) {
+    int64_t bound_us = (int64_t)opts.preempt_bound_ms * 1000;
+    int64_t next_check = elapsed_us() + bound_us;
+    int check_exit = 1;
+    for (;;) {
+        if (ring) {
+            drain_events();
+        }
+        confirm_stops(d);
+        process *r = d->currently_running;
+        if (r && r->state != finished && check_exit && reap_process(r, 0)) {
+            trace("exit job %d\n", r->id);
+            stats.early_exits++;
+            if (!opts.wait_for_tick) {
+                leave_cpu(d);
+            }
+        }
+        if (!d->currently_running && !opts.wait_for_tick) {
+            dispatch(d);
+        }
+        int64_t now = elapsed_us();
+        if (now >= tick_end) {
+            return;
+        }
+        if (bound_us > 0 && now >= next_check) {
+            if (admit_arrivals(d, now) > 0) {
+                preempt(d);
+            }
+            next_check = now + bound_us;
+            continue;
+        }
+        int64_t wake = tick_end;
+        if (bound_us > 0 && next_check < wake) {
+            wake = next_check;
+        }
+        int64_t deadline = next_stop_deadline();
+        if (deadline >= 0 && deadline < wake) {
+            wake = deadline;
+        }
+        // fds[0] and fds[1] are fixed; output pipes follow in capturing order
+        static struct pollfd *fds = 0;
+        static int fds_cap = 0;
+        int nfds = 2 + sizeDA(capturing);
+        if (nfds > fds_cap) {
+            fds_cap = nfds * 2;
+            fds = realloc(fds, sizeof(struct pollfd) * fds_cap);
+            assert(fds != 0);
+        }
+        fds[0] = (struct pollfd){ chld_fd, POLLIN, 0 };
+        fds[1] = (struct pollfd){ -1, POLLIN, 0 };
+        r = d->currently_running;
+        if (r && r->state != finished) {
+            fds[1].fd = r->pidfd;
+        }
+        int i;
+        for (i = 2; i < nfds; i++) {
+            fds[i] = (struct pollfd){ ((process *)getDA(capturing, i - 2))->out_fd, POLLIN, 0 };
+        }
+        struct timespec ts;
+        ts.tv_sec = (wake - now) / USEC_PER_SEC;
+        ts.tv_nsec = (wake - now) % USEC_PER_SEC * 1000;
+        ppoll(fds, nfds, &ts, 0);
+        struct signalfd_siginfo si;
+        while (read(chld_fd, &si, sizeof(si)) > 0) {
+        }
+        // backwards, as a pipe that is done swaps the last one into its place
+        for (i = nfds - 1; i >= 2; i--) {
+            if (fds[i].revents) {
+                capture_output((process *)getDA(capturing, i - 2), 0);
+            }
+        }
+        // without a pidfd every SIGCHLD may be the running process exiting
+        check_exit = fds[1].fd < 0 || fds[1].revents != 0 || fds[0].revents != 0;
+    }
+}
+
+// Stands in for wait_for_tick when simulating. Nothing can exit early, so
+// the only events between ticks are the arrival checks every
+// preempt_bound_ms; the clock jumps to the first check that has something to
+// admit, and then to tick_end. Whatever is admitted starts as it would in a
+// real run: a system process at once, anything else only if the CPU is idle.
+
+void simulate_tick(dispatcher *d, int64_t tick_end) {
+    int64_t bound_us = (int64_t)opts.preempt_bound_ms * 1000;
+    int64_t next_check = virtual_us + bound_us;
+    int64_t arrival;
+    while (bound_us > 0 && (arrival = next_arrival(d)) >= 0) {
+        if (arrival > next_check) {
+            next_check += (arrival - next_check + bound_us - 1) / bound_us * bound_us;
+        }
+        if (next_check >= tick_end) {
+            break;
+        }
+        virtual_us = next_check;
+        if (admit_arrivals(d, virtual_us) > 0) {
+            preempt(d);
+        }
+        // an idle CPU takes whatever was admitted, as it would at once
+        if (!d->currently_running && !opts.wait_for_tick) {
+            dispatch(d);
+        }
+        next_check = virtual_us + bound_us;
+    }
+    virtual_us = tick_end;
+}
+
+// Empties the processes' event rings in batches, printing each batch with a
+// single write if verbose.
+
+void drain_events(void) {
+    static JOBEVENT batch[EVENT_BATCH];
+    static char buf[EVENT_BATCH * 48];
+    int n;
+    while ((n = drainJOBSHM(ring, batch, EVENT_BATCH)) > 0) {
+        stats.events += n;
+        if (!opts.verbose) {
+            continue;
+        }
+        int len = 0;
+        int i;
+        for (i = 0; i < n; i++) {
+            JOBEVENT *e = &batch[i];
+            len += snprintf(buf + len, sizeof(buf) - len, "%10.3f %7d ",
+                            (e->time_us - epoch_us) / 1e6, (int)e->pid);
+            switch (e->type) {
+            case JOB_START:
+                len += snprintf(buf + len, sizeof(buf) - len, "START\n");
+                break;
+            case JOB_TICK:
+                len += snprintf(buf + len, sizeof(buf) - len, "tick %d\n", e->value);
+                break;
+            case JOB_SIGNAL:
+                len += snprintf(buf + len, sizeof(buf) - len, "SIG%s\n", sigabbrev_np(e->value));
+                break;
+            case JOB_PARK:
+                len += snprintf(buf + len, sizeof(buf) - len, "park\n");
+                break;
+            case JOB_RESUME:
+                len += snprintf(buf + len, sizeof(buf) - len, "resume\n");
+                break;
+            default:
+                len += snprintf(buf + len, sizeof(buf) - len, "exit\n");
+                break;
+            }
+        }
+        writeTRACER(out, buf, len);
+    }
+}
+
+// Adds a record, stamped with the time since tick 0, to the trace if there
+// is one. Only the formatting happens here; the writer thread does the I/O.
+
+void trace(const char *fmt, ...) {
+    if (!tracer) {
+        return;
+    }
+    char buf[TRACE_LINE];
+    int len = snprintf(buf, TRACE_LINE, "%10.3f ", elapsed_us() / 1e6);
+    va_list ap;
+    va_start(ap, fmt);
+    len += vsnprintf(buf + len, TRACE_LINE - len, fmt, ap);
+    va_end(ap);
+    // a record cut short still ends its line
+    if (len >= TRACE_LINE) {
+        len = TRACE_LINE - 1;
+        buf[len - 1] = '\n';
+    }
+    writeTRACER(tracer, buf, len);
+}
+
+// Traces what runs for the coming tick and the ids of the processes in each
+// run queue, formatted into a single record.
+
+void trace_tick(dispatcher *d) {
+    if (!tracer) {
+        return;
+    }
+    char buf[TRACE_LINE];
+    int len = job_policy->format(d, buf, TRACE_LINE);
+    if (d->edf.size > 0) {
+        len += snprintf(buf + len, TRACE_LINE - len, " edf ");
+        format_heap(buf + len, TRACE_LINE - len, &d->edf);
+    }
+    if (d->currently_running) {
+        trace("tick %d run job %d rq%s\n", d->curr_time, d->currently_running->id, buf);
+    } else {
+        trace("tick %d idle rq%s\n", d->curr_time, buf);
+    }
+}
+
+// Formats the four run queues as " [a b] [c] [] [d]" into buf. Returns the
+// length written, which is less than size.
+
+int format_queues(dispatcher *d, char *buf, int size) {
+    int len = 0;
+    int i;
+    buf[0] = '\0';
+    for (i = 0; i < 4 && len < size - 1; i++) {
+        len += snprintf(buf + len, size - len, " ");
+        len += format_queue(buf + len, size - len, d->rq[i]);
+    }
+    return len < size ? len : size - 1;
+}
+
+// Formats the four heaps of an SRTF policy the same way, each in heap order:
+// the first process is the next to run, the others are only partly sorted.
+
+int format_heaps(dispatcher *d, char *buf, int size) {
+    int len = 0;
+    int i;
+    buf[0] = '\0';
+    for (i = 0; i < 4 && len < size - 1; i++) {
+        len += snprintf(buf + len, size - len, " ");
+        len += format_heap(buf + len, size - len, &d->ready[i]);
+    }
+    return len < size ? len : size - 1;
+}
+
+// Formats the ids of the processes in h as "[a b c]", as format_queue does.
+
+int format_heap(char *buf, int size, heap *h) {
+    if (size < 8) {
+        return 0;
+    }
+    int len = 1;
+    buf[0] = '[';
+    int i;
+    for (i = 0; i < h->size; i++) {
+        int n = snprintf(buf + len, size - len, i ? " %d" : "%d", h->arr[i]->id);
+        if (n >= size - len - 5) {
+            len += snprintf(buf + len, size - len, "...");
+            break;
+        }
+        len += n;
+    }
+    len += snprintf(buf + len, size - len, "]");
+    return len;
+}
+
+// Formats the ids of the processes in q as "[a b c]" into buf, the way
+// displayCDA would but without a stdio call per process. A queue that doesn't
+// fit ends in "...]". Returns the length written, which is less than size.
+
+int format_queue(char *buf, int size, CDA *q) {
+    if (size < 8) {
+        return 0;
+    }
+    int len = 1;
+    buf[0] = '[';
+    int i;
+    for (i = 0; i < sizeCDA(q); i++) {
+        process *p = (process *)getCDA(q, i);
+        int n = snprintf(buf + len, size - len, i ? " %d" : "%d", p->id);
+        if (n >= size - len - 5) {
+            len += snprintf(buf + len, size - len, "...");
+            break;
+        }
+        len += n;
+    }
+    len += snprintf(buf + len, size - len, "]");
+    return len;
+}
+
+// Handles what has come in on the control socket since the last tick, all
+// taken at once without waiting for the control thread. Submitted jobs join
+// the dispatch list, to be admitted as usual once they have arrived. A
+// restart waits until everything else taken with it has been handled. This
+// is at the top of the tick, so a process a cancel lets go of that should
+// preempt does at the tick's dispatch.
+
+void take_requests(dispatcher *d) {
+    REQUEST *restart = 0;
+    REQUEST *r = takeCONTROL(control);
+    while (r) {
+        REQUEST *next = r->next;
+        if (r->type == REQ_RESTART && !restart) {
+            restart = r;
+        } else {
+            handle_request(d, r);
+        }
+        r = next;
+    }
+    if (restart) {
+        restart_dispatcher(d, restart);
+    }
+}
+
+// Carries out one request from the control socket and answers it.
+
+void handle_request(dispatcher *d, REQUEST *r) {
+    char reply[TRACE_LINE];
+    process *p = 0;
+    if (r->id >= 0 && r->id < sizeCDA(d->dispatch_queue)) {
+        p = (process *)getCDA(d->dispatch_queue, r->id);
+    }
+    switch (r->type) {
+    case REQ_SUBMIT:
+        p = new_proc(r->arrival, r->priority, r->proc_time);
+        double deadline = -1;
+        const char *deps = 0;
+        // ids are handed out in order and requests taken in order, so
+        // a job's id stays its position in the dispatch list
+        p->id = r->id;
+        if (r->command) {
+            const char *rest = parse_fields(r->command, &deadline, &deps);
+            if (rest) {
+                p->cmd = internCOMMANDS(commands, rest);
+            }
+            if (deps && add_dependencies(d, p, deps) < 0) {
+                p->cmd = 0;
+            }
+            free(r->command);
+        }
+        if (r->relative) {
+            p->arrival_us += (int64_t)d->curr_time * TICK_US;
+            p->arrival_time = p->arrival_us / USEC_PER_SEC;
+        }
+        if (deadline > 0) {
+            p->deadline_us = p->arrival_us + (int64_t)(deadline * USEC_PER_SEC);
+        } else if (deadline != -1) {
+            p->cmd = 0;
+        }
+        assert(p->id == sizeCDA(d->dispatch_queue));
+        insertCDAback(d->dispatch_queue, p);
+        if (p->waiting_on == 0) {
+            add_arrival(d, p);
+        }
+        stats.submitted++;
+        // the id was acknowledged already, so a job with nothing to run,
+        // or that came after a shutdown, is kept in place but never started
+        if (!p->cmd || !accepting) {
+            cancel_process(d, p);
+        }
+        free(r);
+        break;
+    case REQ_QUERY: {
+        int len = snprintf(reply, TRACE_LINE, "tick %d ", d->curr_time);
+        if (d->currently_running) {
+            len += snprintf(reply + len, TRACE_LINE - len, "run job %d rq",
+                            d->currently_running->id);
+        } else {
+            len += snprintf(reply + len, TRACE_LINE - len, "idle rq");
+        }
+        len += job_policy->format(d, reply + len, TRACE_LINE - len);
+        if (d->edf.size > 0) {
+            len += snprintf(reply + len, TRACE_LINE - len, " edf ");
+            len += format_heap(reply + len, TRACE_LINE - len, &d->edf);
+        }
+        snprintf(reply + len, TRACE_LINE - len, " pending %d",
+                 sizeCDA(d->dispatch_queue) - d->num_procs_processed);
+        answer(r, reply);
+        break;
+    }
+    case REQ_CHECKPOINT: {
+        const char *why = checkpoint(d, r->command);
+        if (why) {
+            snprintf(reply, TRACE_LINE, "checkpoint error %s", why);
+        } else {
+            snprintf(reply, TRACE_LINE, "checkpoint ok %d jobs tick %d",
+                     sizeCDA(d->dispatch_queue), d->curr_time);
+        }
+        free(r->command);
+        r->command = 0;
+        answer(r, reply);
+        break;
+    }
+    case REQ_RESTART:
+        // take_requests restarts for the first; there is nothing left to
+        // restart for the others
+        free(r->command);
+        r->command = 0;
+        answer(r, "restart error already restarting");
+        break;
+    case REQ_CANCEL:
+        if (!p) {
+            snprintf(reply, TRACE_LINE, "cancel %d error no such job", r->id);
+        } else if (cancel_process(d, p) < 0) {
+            snprintf(reply, TRACE_LINE, "cancel %d error finished", r->id);
+        } else {
+            snprintf(reply, TRACE_LINE, "cancel %d ok", r->id);
+        }
+        answer(r, reply);
+        break;
+    default:
+        // jobs that have arrived still run; nothing new will arrive
+        accepting = 0;
+        int i;
+        for (i = 0; i < sizeCDA(d->dispatch_queue); i++) {
+            p = (process *)getCDA(d->dispatch_queue, i);
+            if (p->state == pending) {
+                cancel_process(d, p);
+            }
+        }
+        answer(r, "shutdown ok");
+        break;
+    }
+}
+
+// Replies to a request, or just frees it once the socket has been closed.
+
+void answer(REQUEST *r, const char *text) {
+    if (control) {
+        replyCONTROL(control, r, text);
+    } else {
+        free(r->command);
+        free(r);
+    }
+}
+
+// Writes the state at the top of this tick to a snapshot at path: every job,
+// the run queues and deferred FIFOs each in its own order, and the pids of
+// the processes started, with when each pid started, so that a restore can
+// tell them from whatever is given their pids later. Pipelined stops are
+// confirmed first, so that every process is as its state says. Cgroups, ring
+// slots and output pipes live only as long as the dispatcher, so runs using
+// them can't be checkpointed. Returns 0, or why it couldn't.
+
+const char *checkpoint(dispatcher *d, const char *path) {
+    if (run_cg || ring || opts.log_dir) {
+        return "not with --cgroup, --ring or --log-dir";
+    }
+    while (sizeDA(stopping) > 0) {
+        confirm_stop((process *)getDA(stopping, 0));
+    }
+    int n = sizeCDA(d->dispatch_queue);
+    SNAPHEADER h;
+    memset(&h, 0, sizeof(h));
+    h.pid = getpid();
+    h.num_jobs = n;
+    h.curr_time = d->curr_time;
+    h.num_procs_processed = d->num_procs_processed;
+    h.running = d->currently_running ? d->currently_running->id : -1;
+    h.accepting = accepting;
+    snprintf(h.policy, sizeof(h.policy), "%s", job_policy->name);
+    heap *heaps[] = { &d->ready[0], &d->ready[1], &d->ready[2], &d->ready[3], &d->edf };
+    int i, j, k = 0;
+    for (i = 0; i < 4; i++) {
+        h.queue_sizes[i] = sizeCDA(d->rq[i]);
+        h.queue_sizes[4 + i] = heaps[i]->size;
+        h.num_ints += h.queue_sizes[i] + h.queue_sizes[4 + i];
+    }
+    h.queue_sizes[8] = heaps[4]->size;
+    h.num_ints += h.queue_sizes[8];
+    for (i = 0; i < 4; i++) {
+        h.queue_sizes[9 + i] = sizeCDA(d->deferred[i]);
+        h.num_ints += h.queue_sizes[9 + i];
+    }
+    for (i = 0; i < n; i++) {
+        h.num_ints += ((process *)getCDA(d->dispatch_queue, i))->num_dependents;
+    }
+    SNAPJOB *jobs = (SNAPJOB *)calloc(n ? n : 1, sizeof(SNAPJOB));
+    int *ints = (int *)malloc(sizeof(int) * (h.num_ints ? h.num_ints : 1));
+    assert(jobs != 0 && ints != 0);
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < sizeCDA(d->rq[i]); j++) {
+            ints[k++] = ((process *)getCDA(d->rq[i], j))->id;
+        }
+    }
+    // a heap's array is already in an order it can be put back in as it is
+    for (i = 0; i < 5; i++) {
+        for (j = 0; j < heaps[i]->size; j++) {
+            ints[k++] = heaps[i]->arr[j]->id;
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < sizeCDA(d->deferred[i]); j++) {
+            ints[k++] = ((process *)getCDA(d->deferred[i], j))->id;
+        }
+    }
+    // each distinct command is written once, and found again by its address
+    int slots = 16;
+    while (slots < 2 * sizeCOMMANDS(commands)) {
+        slots *= 2;
+    }
+    const COMMAND **keys = (const COMMAND **)calloc(slots, sizeof(COMMAND *));
+    int *offsets = (int *)malloc(sizeof(int) * slots);
+    size_t strings_size = 0, strings_cap = 4096;
+    char *strings = (char *)malloc(strings_cap);
+    assert(keys != 0 && offsets != 0 && strings != 0);
+    for (i = 0; i < n; i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        SNAPJOB *job = &jobs[i];
+        job->arrival_us = p->arrival_us;
+        job->start_us = p->start_us;
+        job->end_us = p->end_us;
+        job->deadline_us = p->deadline_us;
+        job->cpu_us = p->cpu_us;
+        job->resumed_us = p->resumed_us;
+        job->density = p->density;
+        job->arrival_time = p->arrival_time;
+        job->priority = p->priority;
+        job->proc_time = p->proc_time;
+        job->service_time = p->service_time;
+        job->ticks = p->ticks;
+        job->state = p->state;
+        job->pid = p->pid;
+        job->edf = p->edf;
+        job->critical = p->critical;
+        job->waiting_on = p->waiting_on;
+        job->deadline_pending = pendingTIMER(&p->deadline_timer);
+        job->deferred = p->deferred;
+        job->last_cpu = p->last_cpu;
+        job->home = p->home;
+        if (p->pid > 0 && p->state != finished) {
+            pid_t ppid;
+            proc_identity(p->pid, &ppid, &job->pid_start);
+        }
+        job->first_dependent = k;
+        job->num_dependents = p->num_dependents;
+        for (j = 0; j < p->num_dependents; j++) {
+            ints[k++] = p->dependents[j]->id;
+        }
+        job->command = -1;
+        if (!p->cmd) {
+            continue;
+        }
+        int slot = ((uintptr_t)p->cmd / sizeof(COMMAND)) & (slots - 1);
+        while (keys[slot] && keys[slot] != p->cmd) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (!keys[slot]) {
+            size_t len = strlen(p->cmd->text) + 1;
+            while (strings_size + len > strings_cap) {
+                strings_cap *= 2;
+                strings = (char *)realloc(strings, strings_cap);
+                assert(strings != 0);
+            }
+            memcpy(strings + strings_size, p->cmd->text, len);
+            keys[slot] = p->cmd;
+            offsets[slot] = strings_size;
+            strings_size += len;
+        }
+        job->command = offsets[slot];
+    }
+    h.strings_size = strings_size;
+    h.stats_size = sizeof(statistics);
+    SNAPSHOT snap = { &h, jobs, ints, strings, &stats, 0, 0 };
+    int rc = writeSNAPSHOT(path, &snap);
+    int saved = errno;
+    free(jobs);
+    free(ints);
+    free(keys);
+    free(offsets);
+    free(strings);
+    if (rc < 0) {
+        return strerror(saved);
+    }
+    trace("checkpoint tick %d\n", d->curr_time);
+    return 0;
+}
+
+// Restarts the dispatcher in place from a checkpoint: the snapshot is written,
+// the control socket closed once the reply has gone, and the program run
+// afresh with --restore and the options it had. The pid stays the same, so
+// every process it started is still its child. Submissions that came in
+// before the socket closed go into the snapshot too. If the snapshot can't be
+// written the dispatcher carries on as it was.
+
+void restart_dispatcher(dispatcher *d, REQUEST *r) {
+    char reply[TRACE_LINE];
+    char *path = r->command;
+    r->command = 0;
+    const char *why = checkpoint(d, path);
+    if (why) {
+        snprintf(reply, TRACE_LINE, "restart error %s", why);
+        answer(r, reply);
+        free(path);
+        return;
+    }
+    answer(r, "restart ok");
+    REQUEST *late = closeCONTROL(control);
+    control = 0;
+    if (late) {
+        while (late) {
+            REQUEST *next = late->next;
+            handle_request(d, late);
+            late = next;
+        }
+        if ((why = checkpoint(d, path))) {
+            fprintf(stderr, "can't checkpoint to %s (%s); carrying on without the socket.\n",
+                    path, why);
+            accepting = 0;
+            free(path);
+            return;
+        }
+    }
+    if (tracer && tracer != out) {
+        freeTRACER(tracer, &stats.trace);
+    }
+    if (out) {
+        freeTRACER(out, tracer == out ? &stats.trace : &stats.out);
+    }
+    tracer = out = 0;
+    char **argv = (char **)malloc(sizeof(char *) * (restart_argc + 3));
+    assert(argv != 0);
+    memcpy(argv, restart_argv, sizeof(char *) * restart_argc);
+    argv[restart_argc] = "--restore";
+    argv[restart_argc + 1] = path;
+    argv[restart_argc + 2] = 0;
+    execv("/proc/self/exe", argv);
+    perror("restart");
+    exit(1);
+}
+
+// Reads the jobs and run queues back from a snapshot in place of a dispatch
+// list, and schedules them by the policy it was taken under. The processes
+// it had started are taken back once the rest is set up, by
+// adopt_processes(). Returns 0, or -1 if it can't be read or doesn't hold
+// together.
+
+int restore(dispatcher *d, const char *path) {
+    restore_start_us = clock_us();
+    SNAPSHOT *s = mapSNAPSHOT(path);
+    if (!s) {
+        fprintf(stderr, "can't restore from %s (%s).\n", path, strerror(errno));
+        return -1;
+    }
+    const SNAPHEADER *h = s->header;
+    int n = h->num_jobs;
+    const policy *found = 0;
+    int i, j, k;
+    for (i = 0; policies[i]; i++) {
+        if (strcmp(policies[i]->name, h->policy) == 0) {
+            found = policies[i];
+        }
+    }
+    int ok = found && h->running >= -1 && h->running < n && h->curr_time >= 0
+             && h->num_procs_processed >= 0 && h->num_procs_processed <= n;
+    for (i = 0; ok && i < h->num_ints; i++) {
+        ok = s->ints[i] >= 0 && s->ints[i] < n;
+    }
+    int deferred = 0;
+    for (i = 9; i < SNAPSHOT_QUEUES; i++) {
+        deferred -= h->queue_sizes[i];
+    }
+    for (i = 0; ok && i < n; i++) {
+        const SNAPJOB *job = &s->jobs[i];
+        deferred += job->deferred && job->state == pending;
+        ok = job->state >= pending && job->state <= finished && job->priority >= 0
+             && job->priority <= 3 && job->command >= -1 && job->command < h->strings_size
+             && job->first_dependent >= 0 && job->num_dependents >= 0
+             && (long long)job->first_dependent + job->num_dependents <= h->num_ints;
+    }
+    // each job held back is in a deferred FIFO, or it would never be admitted
+    ok = ok && deferred == 0;
+    for (i = 0; ok && i < n; i++) {
+        const SNAPJOB *job = &s->jobs[i];
+        process *p = new_proc(0, job->priority, job->proc_time);
+        p->id = i;
+        p->arrival_time = job->arrival_time;
+        p->arrival_us = job->arrival_us;
+        p->start_us = job->start_us;
+        p->end_us = job->end_us;
+        p->deadline_us = job->deadline_us;
+        p->cpu_us = job->cpu_us;
+        p->resumed_us = job->resumed_us;
+        p->pid_start = job->pid_start;
+        p->density = job->density;
+        p->service_time = job->service_time;
+        p->ticks = job->ticks;
+        p->state = job->state;
+        p->pid = job->pid;
+        p->edf = job->edf;
+        p->critical = job->critical;
+        p->waiting_on = job->waiting_on;
+        p->deferred = job->deferred;
+        p->last_cpu = job->last_cpu;
+        p->home = job->home;
+        p->cmd = job->command >= 0 ? internCOMMANDS(commands, s->strings + job->command) : 0;
+        insertCDAback(d->dispatch_queue, p);
+    }
+    for (i = 0; ok && i < n; i++) {
+        const SNAPJOB *job = &s->jobs[i];
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        if (job->num_dependents > 0) {
+            p->dependents = (process **)malloc(sizeof(process *) * job->num_dependents);
+            assert(p->dependents != 0);
+            p->num_dependents = p->dependents_cap = job->num_dependents;
+            for (j = 0; j < job->num_dependents; j++) {
+                p->dependents[j] =
+                    (process *)getCDA(d->dispatch_queue, s->ints[job->first_dependent + j]);
+            }
+        }
+        // one deferred has arrived, and waits in its FIFO instead
+        if (p->state == pending && p->waiting_on == 0 && !job->deferred) {
+            add_arrival(d, p);
+        }
+        if (job->deadline_pending) {
+            addWHEEL(d->timers, &p->deadline_timer, p->deadline_us);
+        }
+        if (p->edf && p->state != pending && p->state != finished) {
+            d->edf_load += p->density;
+        }
+    }
+    heap *heaps[] = { &d->ready[0], &d->ready[1], &d->ready[2], &d->ready[3], &d->edf };
+    // a job is in at most one queue or heap, and the running one in none, or
+    // it would be dispatched twice
+    char *placed = (char *)calloc(n ? n : 1, 1);
+    assert(placed != 0);
+    for (i = 0, k = 0; ok && i < SNAPSHOT_QUEUES; i++) {
+        for (j = 0; ok && j < h->queue_sizes[i]; j++) {
+            int id = s->ints[k++];
+            process *p = (process *)getCDA(d->dispatch_queue, id);
+            ok = !placed[id] && id != h->running;
+            placed[id] = 1;
+            if (!ok) {
+                break;
+            }
+            if (i >= 9) {
+                ok = p->state == pending && p->deferred && p->waiting_on == 0;
+                if (ok) {
+                    insertCDAback(d->deferred[i - 9], p);
+                }
+                continue;
+            }
+            ok = p->state == ready || p->state == waiting;
+            if (ok && i < 4) {
+                insertCDAback(d->rq[i], p);
+            } else if (ok) {
+                heap *q = heaps[i - 4];
+                heap_reserve(q, h->queue_sizes[i]);
+                q->arr[j] = p;
+                p->heap_index = j;
+                q->size = j + 1;
+            }
+        }
+    }
+    free(placed);
+    if (!ok) {
+        fprintf(stderr, "%s is not a snapshot this dispatcher can resume from.\n", path);
+        unmapSNAPSHOT(s);
+        return -1;
+    }
+    job_policy = found;
+    d->currently_running = h->running >= 0 ? (process *)getCDA(d->dispatch_queue, h->running) : 0;
+    d->curr_time = h->curr_time;
+    d->num_procs_processed = h->num_procs_processed;
+    restored_accepting = h->accepting;
+    if (h->stats_size == sizeof(statistics)) {
+        memcpy(&stats, s->stats, sizeof(statistics));
+    }
+    stats.restored = n;
+    stats.adopted = stats.lost = 0;
+    unmapSNAPSHOT(s);
+    return 0;
+}
+
+// Takes back the processes a restored snapshot had started. One still alive
+// under its pid, and started when the snapshot says, is still this
+// dispatcher's child if it restarted in place, and is adopted if not; an
+// adopted one is put back as the snapshot left it, running if it held the
+// CPU and stopped if not, as losing its parent may have woken it, and keeps
+// the CPU it was pinned to as its home. One that has gone exited with no
+// dispatcher to see it, and is finished here.
+
+void adopt_processes(dispatcher *d) {
+    int i;
+    for (i = 0; i < sizeCDA(d->dispatch_queue); i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        int home = p->home;
+        p->home = -1;
+        if (p->pid <= 0 || p->state == pending || p->state == finished) {
+            continue;
+        }
+        pid_t ppid;
+        unsigned long long start;
+        if (proc_identity(p->pid, &ppid, &start) < 0 || start != p->pid_start) {
+            trace("lost job %d\n", p->id);
+            stats.lost++;
+            end_run(p);
+            p->end_us = elapsed_us();
+            p->state = finished;
+            p->proc_time = 0;
+            // one that held the CPU leaves it at the next tick
+            if (p != d->currently_running) {
+                forget(d, p);
+            }
+            continue;
+        }
+        char stat_path[64];
+        snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", (int)p->pid);
+        p->stat_fd = open(stat_path, O_RDONLY | O_CLOEXEC);
+#ifdef SYS_pidfd_open
+        p->pidfd = syscall(SYS_pidfd_open, p->pid, 0);
+#endif
+        p->adopted = ppid != getpid();
+        if (p->adopted) {
+            kill(-p->pid, p == d->currently_running ? SIGCONT : SIGSTOP);
+        }
+        if (opts.affinity && home >= 0 && home < num_cpus) {
+            p->home = home;
+            cpu_homes[home]++;
+        }
+        stats.adopted++;
+    }
+    stats.restore_us = clock_us() - restore_start_us;
+}
+
+// Reads the parent of a process and when it started, in clock ticks after
+// boot, from /proc. Returns 0, or -1 if there is no such process.
+
+int proc_identity(pid_t pid, pid_t *ppid, unsigned long long *start) {
+    char path[64], buf[BUF_SIZE];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    char *fields = strrchr(buf, ')');
+    int parent;
+    if (!fields || sscanf(fields + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u"
+                          " %*d %*d %*d %*d %*d %*d %llu", &parent, start) != 2) {
+        return -1;
+    }
+    *ppid = parent;
+    return 0;
+}
+
+// Returns whether an adopted process has exited, waiting until it has if
+// block is set. It isn't the dispatcher's child, so there is no waiting for
+// it: its pidfd, or failing that /proc, is all there is to go by.
+
+int adopted_exited(process *p, int block) {
+    for (;;) {
+        int gone;
+        if (p->pidfd >= 0) {
+            struct pollfd fd = { p->pidfd, POLLIN, 0 };
+            gone = poll(&fd, 1, block ? -1 : 0) > 0;
+        } else {
+            int state = sample_cpu(p);
+            gone = state == 0 || state == 'Z' || state == 'X';
+        }
+        if (gone || !block) {
+            return gone;
+        }
+        if (p->pidfd < 0) {
+            usleep(1000);
+        }
+    }
+}
+
+// Removes a process from the dispatcher, wherever it is: one that hasn't
+// arrived never will, and one that has is taken off its run queue and
+// terminated if it has started. Returns -1 if it had already finished, and
+// otherwise 1 if a process waiting on it should preempt at once, 0 if not.
 
-void startProcess(process *);
-void terminateProcess(process *);
-void suspendProcess(process *);
-void restartProcess(process *);
-DA *get_procs_with_arrival_time(CDA *, int);
-process *new_proc(int, int, int);
-void display_proc(FILE *, void *);
+int cancel_process(dispatcher *d, process *p) {
+    if (p->state == finished) {
+        return -1;
+    }
+    trace("cancel job %d\n", p->id);
+    int urgent;
+    if (p == d->currently_running) {
+        terminateProcess(p);
+        urgent = leave_cpu(d);
+    } else if (p->state == pending) {
+        cancelWHEEL(d->timers, &p->arrival_timer);
+        if (p->deferred) {
+            remove_from_queue(d->deferred[queue_of(p)], p);
+        }
+        d->num_procs_processed++;
+        p->state = finished;
+        urgent = release_dependents(d, p);
+    } else {
+        urgent = forget(d, p);
+        // one admitted but not yet started has nothing to end
+        if (p->start_us >= 0) {
+            terminateProcess(p);
+        }
+    }
+    p->state = finished;
+    p->proc_time = 0;
+    stats.cancelled++;
+    return urgent;
+}
 
+// Takes p out of q, leaving the other processes in order.
 
+void remove_from_queue(CDA *q, process *p) {
+    int n = sizeCDA(q);
+    int i;
+    for (i = 0; i < n; i++) {
+        process *front = (process *)removeCDAfront(q);
+        if (front != p) {
+            insertCDAback(q, front);
+        }
+    }
+}
 
-DA *newDA(void (*d)(FILE *,void *));
-void insertDA(DA *items,void *value);
-void *removeDA(DA *items);
-void unionDA(DA *recipient,DA *donor);
-void *getDA(DA *items,int index);
-void *setDA(DA *items,int index,void *value);
-void **extractDA(DA *items);
-int sizeDA(DA *items);
-void visualizeDA(FILE *fp,DA *items);
-void displayDA(FILE *fp,DA *items);
+// Opens the log that the output of the process goes to: its own, named by its
+// id, or the one for the priority it starts at. Returns 0 if the log can't be
+// opened, and the process is left to write to the dispatcher's stdout.
 
+JOBLOG *open_log(process *p) {
+    char path[BUF_SIZE];
+    if (opts.log_by_level && level_logs[p->priority]) {
+        return level_logs[p->priority];
+    }
+    if (opts.log_by_level) {
+        snprintf(path, BUF_SIZE, "%s/level.%d.log", opts.log_dir, p->priority);
+    } else {
+        snprintf(path, BUF_SIZE, "%s/job.%d.log", opts.log_dir, p->id);
+    }
+    JOBLOG *log = newJOBLOG(path, (long long)opts.log_size_kb * 1024);
+    if (!log) {
+        fprintf(stderr, "can't open %s (%s); output not captured.\n", path, strerror(errno));
+    } else if (opts.log_by_level) {
+        level_logs[p->priority] = log;
+    }
+    return log;
+}
 
+// Moves what the process has written from its pipe to its log: at most
+// LOG_BUDGET bytes, so a chatty process can't hold up scheduling, or
+// everything there is if final is set. Once the pipe has been closed by
+// every process in the job, or if final is set, stops capturing.
+// Returns 1 while still capturing.
 
-CDA *newCDA(void (*d)(FILE *,void *));
-void insertCDAfront(CDA *items,void *value);
-void insertCDAback(CDA *items,void *value);
-void *removeCDAfront(CDA *items);
-void *removeCDAback(CDA *items);
-void unionCDA(CDA *recipient,CDA *donor);
-void *getCDA(CDA *items,int index);
-void *setCDA(CDA *items,int index,void *value);
-void **extractCDA(CDA *items);
-int sizeCDA(CDA *items);
-void visualizeCDA(FILE *,CDA *items);
-void displayCDA(FILE *,CDA *items);
+int capture_output(process *p, int final) {
+    ssize_t n;
+    do {
+        n = spliceJOBLOG(p->log, p->out_fd, LOG_BUDGET);
+        if (n > 0) {
+            stats.log_bytes += n;
+        }
+    } while (final && n > 0);
+    if (n != 0 && !final) {
+        return 1;
+    }
+    close(p->out_fd);
+    p->out_fd = -1;
+    if (!opts.log_by_level) {
+        freeJOBLOG(p->log);
+    }
+    p->log = 0;
+    int i;
+    for (i = 0; getDA(capturing, i) != p; i++) {
+    }
+    setDA(capturing, i, getDA(capturing, sizeDA(capturing) - 1));
+    removeDA(capturing);
+    return 0;
+}
 
+// With --yield, asks a process that follows the ring's yield protocol to
+// park, and waits for it to. Returns 1 if it parked; 0 if it doesn't
+// cooperate or didn't park in time, and has to be stopped with a signal.
+// Parking is always confirmed here, even when pipelined, since it takes no
+// longer than a stop confirmation would.
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        printf("usage: ./dispatcher [dispatch_list]\n");
-        return 1;
+int yield_process(process *p) {
+    if (!opts.yield_timeout_ms || !p->slot || !cooperativeJOBSLOT(p->slot)) {
+        return 0;
     }
-    
-    FILE *dispatch_file = fopen(argv[1], "r");
-    
-    if (!dispatch_file) {
-        fprintf(stderr, "can't open %s as dispatch_list.\n", argv[1]);
-        return 1;
+    int64_t t = elapsed_us();
+    yieldJOBSLOT(p->slot);
+    if (!parkedJOBSLOT(p->slot, opts.yield_timeout_ms)) {
+        stats.yield_fallbacks++;
+        return 0;
     }
-    
-    CDA *dispatch_queue = newCDA(display_proc);
-    char line_buf[BUF_SIZE];
-    
-    while (fgets(line_buf, BUF_SIZE, dispatch_file)) {
-        int arrival_time, priority, proc_time; 
-        const int got = sscanf(line_buf, "%d,%d,%d", &arrival_time, &priority, &proc_time);
-        if (got != 3) {
-            fprintf(stderr, "error parsing file.\n");
-            return 1;
+    stats.yields++;
+    stats.yield_us += elapsed_us() - t;
+    p->parked = 1;
+    return 1;
+}
+
+// Prints the arrival-to-start latency of the system processes, the
+// turnaround and response of every process, deadlines missed, and the cost
+// of scheduling and context switches.
+
+void print_stats(FILE *fp, dispatcher *d) {
+    int n = 0, done = 0, deadlines = 0, missed = 0, missed_edf = 0;
+    int64_t total = 0, max = 0, turnaround = 0, response = 0, makespan = 0;
+    int i;
+    for (i = 0; i < sizeCDA(d->dispatch_queue); i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        if (p->deadline_us >= 0) {
+            deadlines++;
+            // one that never finished, rejected or not, has missed it too
+            if (p->end_us < 0 || p->end_us > p->deadline_us) {
+                missed++;
+                missed_edf += p->edf;
+            }
+        }
+        if (p->end_us > makespan) {
+            makespan = p->end_us;
+        }
+        if (p->start_us >= 0 && p->end_us >= 0) {
+            turnaround += p->end_us - p->arrival_us;
+            response += p->start_us - p->arrival_us;
+            done++;
+        }
+        if (p->priority != 0 || p->start_us < 0) {
+            continue;
         }
-        process *proc = new_proc(arrival_time, priority, proc_time);
-        insertCDAback(dispatch_queue, proc);
+        int64_t latency = p->start_us - p->arrival_us;
+        total += latency;
+        if (latency > max) {
+            max = latency;
+        }
+        n++;
     }
-    
-    int curr_time = 0;
-    int num_procs_processed = 0; 
-    
-    CDA **rq = malloc(sizeof(CDA *) * 4);
-    
-    for (int i = 0; i < 4; i++) {
-        rq[i] = newCDA(display_proc);
-    }    
-
-    process *currently_running = 0;
-    int sys_running = 0;
-    while (currently_running || num_procs_processed != sizeCDA(dispatch_queue)) {
-        DA *curr_procs = get_procs_with_arrival_time(dispatch_queue, curr_time); 
-        num_procs_processed += sizeDA(curr_procs);
-        int i;
-        for (i = 0; i < sizeDA(curr_procs); i++) {
-            process *curr_proc = (process *)getDA(curr_procs, i);
-            insertCDAback(rq[curr_proc->priority], curr_proc);
+    fprintf(fp, "jobs run as %s, scheduled by %s\n", job_backend->name, job_policy->name);
+    fprintf(fp, "system processes: %d\n", n);
+    if (n > 0) {
+        fprintf(fp, "arrival-to-start latency: mean %.3f ms, max %.3f ms\n",
+                total / (double)n / 1000, max / 1000.0);
+    }
+    if (done > 0) {
+        fprintf(fp, "processes run: %d, mean turnaround %.3f s, mean response %.3f s\n",
+                done, turnaround / (double)done / 1e6, response / (double)done / 1e6);
+    }
+    if (deadlines > 0) {
+        fprintf(fp, "deadlines: %d, %d admitted to edf (bound %d%%), %d downgraded, %d rejected;"
+                " missed %d, %d of them admitted\n", deadlines, stats.edf_admitted,
+                opts.edf_bound, stats.edf_downgraded, stats.edf_rejected, missed, missed_edf);
+    }
+    if (stats.dependencies > 0) {
+        fprintf(fp, "dependencies: %d, %d processes held past arrival, %d boosted on critical"
+                " paths; last finished at %.3f s\n", stats.dependencies, stats.held,
+                stats.boosted, makespan / 1e6);
+    }
+    fprintf(fp, "run queue depth by level, mean/max:");
+    for (i = 0; i < 4; i++) {
+        fprintf(fp, " %.1f/%d", d->curr_time ? stats.queue_sum[i] / (double)d->curr_time : 0.0,
+                stats.queue_max[i]);
+    }
+    fprintf(fp, "\n");
+    if (opts.queue_limits[0] || opts.queue_limits[1] || opts.queue_limits[2]
+        || opts.queue_limits[3]) {
+        static const char *overflows[] = { "defer", "spill", "reject" };
+        fprintf(fp, "queue limits %d,%d,%d,%d, overflow %s: %d held back (max %d at once,"
+                " mean %.3f s, max %.3f s), %d spilled, %d shed\n", opts.queue_limits[0],
+                opts.queue_limits[1], opts.queue_limits[2], opts.queue_limits[3],
+                overflows[opts.overflow], stats.deferred, stats.max_deferred,
+                stats.deferred ? stats.defer_us / (double)stats.deferred / 1e6 : 0.0,
+                stats.max_defer_us / 1e6, stats.spilled, stats.shed);
+    }
+    if (stats.restored > 0) {
+        fprintf(fp, "restored %d jobs from a snapshot in %.3f ms: %d processes taken back,"
+                " %d gone\n", stats.restored, stats.restore_us / 1000.0, stats.adopted,
+                stats.lost);
+    }
+    fprintf(fp, "dispatcher cpu: %.3f s over %d ticks, %.0f ns per tick\n",
+            stats.loop_cpu_ns / 1e9, d->curr_time,
+            d->curr_time ? stats.loop_cpu_ns / (double)d->curr_time : 0.0);
+    if (alloc_count) {
+        fprintf(fp, "heap allocations: %lld before tick 0, %lld in %d ticks", stats.startup_allocs,
+                stats.tick_allocs, stats.alloc_ticks);
+        if (stats.alloc_ticks > 0) {
+            fprintf(fp, ", the last in tick %d", stats.last_alloc_tick);
         }
-        if (currently_running && currently_running->proc_time == 0) {
-            terminateProcess(currently_running);
-            if (sys_running) {
-                sys_running = 0;
-            }
-            currently_running = 0;
-        } 
-      
-        // if there are system processes waiting to be run and one is not already running 
-        if (sizeCDA(rq[0]) > 0 && !sys_running) {
-            // preempt
-            if (currently_running) {
-                suspendProcess(currently_running);
-                insertCDAback(rq[currently_running->priority], currently_running);
-            }
-            process *sys_proc = removeCDAfront(rq[0]);
-            startProcess(sys_proc);
-            currently_running = sys_proc;   
-            sys_running = 1;       
-        }
-        // if sys queue is empty but last sys process running
-        else if (sys_running) {
-
-        }
-        // if no sys process is running and 1st priority queue has some things in it 
-        else if (sizeCDA(rq[1]) > 0) {
-            if (currently_running) {
-                suspendProcess(currently_running);
-                insertCDAback(rq[currently_running->priority], currently_running);
-            }
-            process *one_proc = removeCDAfront(rq[1]);
-            if (one_proc->state == ready) {
-                startProcess(one_proc);
-            } else {
-                restartProcess(one_proc);
-            }
-            currently_running = one_proc;
-            sys_running = 0;
+        fprintf(fp, "\n");
+    }
+    if (!job_backend->virtual_clock) {
+        fprintf(fp, "cpu migrations seen: %d", stats.migrations);
+        if (opts.affinity) {
+            fprintf(fp, "; %d resumed on the cpu they last ran on, %d moved for an imbalance"
+                    " of %d", stats.kept_cpu, stats.moved_cpu, opts.affinity);
         }
-        else if (sizeCDA(rq[2]) > 0) {
-            if (currently_running) {
-                suspendProcess(currently_running);
-                insertCDAback(rq[currently_running->priority], currently_running);
-            }
-            process *two_proc = removeCDAfront(rq[2]);
-            if (two_proc->state == ready) {
-                startProcess(two_proc);
-            } else {
-                restartProcess(two_proc);
-            }
-            currently_running = two_proc;
-            sys_running = 0;
+        fprintf(fp, "\n");
+    }
+    if (stats.late_ticks > 0) {
+        fprintf(fp, "tick lateness: mean %.1f us, max %lld us over %d ticks", stats.late_us
+                / (double)stats.late_ticks, (long long)stats.max_late_us, stats.late_ticks);
+        if (opts.low_jitter) {
+            fprintf(fp, "; %s, memory %s", stats.fifo ? "SCHED_FIFO" : "normal priority",
+                    stats.locked ? "locked" : "not locked");
         }
-        else if (sizeCDA(rq[3]) > 0) {
-            if (currently_running) {
-                suspendProcess(currently_running);
-                insertCDAback(rq[currently_running->priority], currently_running);
-            }
-            process *three_proc = removeCDAfront(rq[3]);
-            if (three_proc->state == ready) {
-                startProcess(three_proc);
+        fprintf(fp, "\n");
+    }
+    if (opts.low_jitter && stats.late_ticks > 0) {
+        long long seen = 0;
+        for (i = 0; !stats.late_hist[i]; i++) {
+        }
+        for (; i < LATE_BUCKETS && seen < stats.late_ticks; i++) {
+            seen += stats.late_hist[i];
+            if (i < LATE_BUCKETS - 1) {
+                fprintf(fp, "  under %8lld us", 1LL << i);
             } else {
-                restartProcess(three_proc);
+                fprintf(fp, "  %8lld us or more", 1LL << (i - 1));
             }
-            currently_running = three_proc;
-            sys_running = 0;
+            fprintf(fp, ": %8lld ticks, %5.1f%% in all\n", stats.late_hist[i],
+                    100.0 * seen / stats.late_ticks);
         }
-        // decrement proc_time
-        if (currently_running) {
-            currently_running->proc_time--; 
-        }
-        curr_time++;
-        free(curr_procs);
-        sleep(TIME_QUANTUM);
     }
-     
+    fprintf(fp, "context switches: %d", stats.switches);
+    if (stats.switches > 0) {
+        fprintf(fp, ", mean %.3f ms from suspend to next start",
+                stats.switch_us / (double)stats.switches / 1000);
+    }
+    fprintf(fp, "\n");
+    if (opts.yield_timeout_ms) {
+        int signal_switches = stats.switches - stats.yield_switches;
+        fprintf(fp, "  by yielding: %d, mean %.3f ms\n", stats.yield_switches,
+                stats.yield_switches ? stats.yield_switch_us / (double)stats.yield_switches / 1000 : 0.0);
+        fprintf(fp, "  by signals:  %d, mean %.3f ms\n", signal_switches,
+                signal_switches ? (stats.switch_us - stats.yield_switch_us)
+                                  / (double)signal_switches / 1000 : 0.0);
+        fprintf(fp, "yields: %d parked, mean %.3f ms after asking; %d fell back to signals\n",
+                stats.yields, stats.yields ? stats.yield_us / (double)stats.yields / 1000 : 0.0,
+                stats.yield_fallbacks);
+    }
+    if (stats.stops > 0) {
+        fprintf(fp, "stops confirmed: mean %.3f ms after suspending\n",
+                stats.stop_us / (double)stats.stops / 1000);
+    }
+    if (opts.pipelined) {
+        fprintf(fp, "pipelined overlap: max %.3f ms, bound enforced %d times\n",
+                stats.max_overlap_us / 1000.0, stats.safeguards);
+    }
+    if (opts.log_dir) {
+        fprintf(fp, "output captured: %lld bytes under %s\n", stats.log_bytes, opts.log_dir);
+    }
+    fprintf(fp, "commands: %d distinct in %.1f kbytes\n", sizeCOMMANDS(commands),
+            bytesCOMMANDS(commands) / 1024.0);
+    if (opts.socket_path) {
+        fprintf(fp, "socket: %d jobs submitted, %d cancelled\n", stats.submitted,
+                stats.cancelled);
+    }
+    if (tracer) {
+        print_writer(fp, "trace", &stats.trace);
+    }
+    if (out && tracer != out) {
+        print_writer(fp, "stdout", &stats.out);
+    }
+    if (ring) {
+        fprintf(fp, "ring events: %lld drained, %lld dropped\n", (long long)stats.events,
+                (long long)stats.events_dropped);
+    }
+    if (opts.fibers) {
+        int64_t real_us = clock_us() - clock_epoch_us;
+        fprintf(fp, "fibers: %lld context switches in %.3f s, %.0f per second\n",
+                switchesFIBER(), real_us / 1e6, real_us ? switchesFIBER() * 1e6 / real_us : 0.0);
+    }
+    int64_t run_us = elapsed_us();
+    fprintf(fp, "early exits: %d, cpu idle %.1f%% of %.3f s\n", stats.early_exits,
+            run_us > 0 ? 100.0 * (run_us - stats.busy_us) / run_us : 0.0, run_us / 1e6);
+    int total_ticks = 0;
+    int64_t total_cpu = 0;
+    fprintf(fp, "charged by %s\n", opts.charge_cpu ? "cpu time" : "ticks");
+    fprintf(fp, "%10s %8s %8s %8s %10s\n", "arrival", "priority", "service", "ticks", "cpu ms");
+    for (i = 0; i < sizeCDA(d->dispatch_queue); i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        fprintf(fp, "%10.3f %8d %8d %8d %10.3f\n", p->arrival_us / 1e6, p->priority,
+                p->service_time, p->ticks, p->cpu_us / 1000.0);
+        total_ticks += p->ticks;
+        total_cpu += p->cpu_us;
+    }
+    fprintf(fp, "total: %d ticks (%.3f s), %.3f s cpu\n", total_ticks,
+            total_ticks * (double)TIME_QUANTUM, total_cpu / 1e6);
+}
+
+// Prints the counters of one of the writer threads.
+
+void print_writer(FILE *fp, const char *name, TRACERSTATS *s) {
+    fprintf(fp, "%s writer: %lld records, %lld bytes in %lld writes, %lld dropped, "
+            "%lld stalls, max %.1f%% full\n", name, s->records, s->bytes, s->batches,
+            s->dropped, s->stalls, s->capacity ? 100.0 * s->max_fill / s->capacity : 0.0);
+}
+
+// Simulates the dispatch list under each configuration of the --sweep spec,
+// spread over a pool of threads, and prints a table of the results. Returns
+// the exit status.
+
+int run_sweep(dispatcher *d) {
+    SWEEPCONFIG *configs;
+    int count = parseSWEEP(opts.sweep, opts.preempt_bound_ms, &configs);
+    if (count < 0) {
+        fprintf(stderr, "can't parse sweep %s.\n", opts.sweep);
+        return 1;
+    }
+    int n = sizeCDA(d->dispatch_queue);
+    SWEEPJOB *jobs = malloc(sizeof(SWEEPJOB) * (n ? n : 1));
+    assert(jobs != 0);
+    int i;
+    for (i = 0; i < n; i++) {
+        process *p = (process *)getCDA(d->dispatch_queue, i);
+        jobs[i].arrival_us = p->arrival_us;
+        jobs[i].priority = p->priority;
+        jobs[i].service = p->service_time;
+    }
+    SWEEP *sweep = newSWEEP(jobs, n);
+    free(jobs);
+    int threads = opts.threads ? opts.threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    SWEEPRESULT *results = malloc(sizeof(SWEEPRESULT) * count);
+    assert(results != 0);
+    int64_t start = clock_us();
+    runSWEEP(sweep, configs, count, threads, results);
+    int64_t wall = clock_us() - start;
+
+    printf("%6s %7s %5s %4s %10s %10s %10s %10s %10s %8s %8s %6s %8s\n", "levels", "quantum",
+           "aging", "cpus", "makespan", "turnaround", "response", "sys ms", "sys max", "switches",
+           "promoted", "util%", "cpu ms");
+    double total_ms = 0;
+    for (i = 0; i < count; i++) {
+        SWEEPCONFIG *c = &configs[i];
+        SWEEPRESULT *r = &results[i];
+        printf("%6d %7d %5d %4d %10.3f %10.3f %10.3f %10.3f %10.3f %8lld %8lld %6.1f %8.1f\n",
+               c->levels, c->quantum, c->aging, c->cpus, r->makespan_us / 1e6,
+               r->turnaround_us / 1e6, r->response_us / 1e6, r->system_latency_us / 1e3,
+               r->max_system_latency_us / 1e3, r->switches, r->promotions,
+               r->makespan_us ? 100.0 * r->busy_us / ((double)r->makespan_us * c->cpus) : 0.0,
+               r->cpu_ms);
+        total_ms += r->cpu_ms;
+    }
+    fprintf(stderr, "%d jobs, %d configurations on %d threads in %.3f s (%.3f s of cpu,"
+            " %.2fx)\n", n, count, threads < count ? threads : count, wall / 1e6,
+            total_ms / 1e3, wall ? total_ms * 1e3 / wall : 0.0);
+    freeSWEEP(sweep);
+    free(configs);
+    free(results);
     return 0;
 }
 
+// The policy's side of starting, suspending, resuming and ending a process.
+// The backend does the rest: fork and signal, nothing at all when
+// simulating, or switch fibers.
+
 void startProcess(process *p) {
+    trace("start job %d\n", p->id);
+    job_backend->start(p);
+    p->resumed_us = elapsed_us();
+    if (p->start_us < 0) {
+        p->start_us = elapsed_us();
+    }
+}
+
+void terminateProcess(process *p) {
+    if (p->state == finished) {
+        return;
+    }
+    trace("terminate job %d\n", p->id);
+    end_run(p);
+    job_backend->terminate(p);
+    if (p->end_us < 0) {
+        p->end_us = elapsed_us();
+    }
+    p->state = finished;
+    p->proc_time = 0;
+}
+
+void suspendProcess(process *p) {
+    end_run(p);
+    job_backend->suspend(p);
+    p->state = waiting;
+    trace("suspend job %d priority %d\n", p->id, p->priority);
+}
+
+void restartProcess(process *p) {
+    trace("resume job %d\n", p->id);
+    job_backend->restart(p);
+    p->resumed_us = elapsed_us();
+}
+
+// Processes run in their own process group, so the signals below reach any
+// helpers they fork as well. With --cgroup each also gets its own cgroup,
+// which is frozen rather than sent SIGTSTP.
+
+void start_os(process *p) {
+    if (run_cg) {
+        char name[32];
+        snprintf(name, sizeof(name), "job.%d", p->id);
+        p->cg = newCGROUP(pathCGROUP(run_cg), name);
+    }
+    if (ring) {
+        p->slot = claimJOBSLOT(ring);
+    }
+    int out[2] = { -1, -1 };
+    if (opts.log_dir && (p->log = open_log(p)) && pipe2(out, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        if (!opts.log_by_level) {
+            freeJOBLOG(p->log);
+        }
+        p->log = 0;
+    }
+    int cpu = opts.affinity ? choose_cpu(p) : -1;
     pid_t child_pid = fork();
     if (child_pid == 0) {
-        char **argv = malloc(sizeof(char *) * 2);
-        argv[0] = "./process";
-        argv[1] = "20";
-        execvp(argv[0], argv);
-        free(argv);    
+        sigprocmask(SIG_UNBLOCK, &chld_mask, 0);
+        setpgid(0, 0);
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        if (p->cg) {
+            joinCGROUP(p->cg);
+        }
+        // the process looks its slot up by pid, so own it before exec
+        if (p->slot) {
+            ownJOBSLOT(p->slot, getpid());
+        }
+        if (out[1] >= 0) {
+            dup2(out[1], STDOUT_FILENO);
+            dup2(out[1], STDERR_FILENO);
+        }
+        // everything was built at load time; nothing is allocated here
+        execve(p->cmd->path, p->cmd->argv, p->cmd->envp);
+        // never fall back into the scheduling loop in the child
+        perror(p->cmd->path);
+        _exit(127);
     } else {
+        setpgid(child_pid, child_pid);
         p->pid = child_pid;
+        if (cpu >= 0) {
+            p->home = cpu;
+            cpu_homes[cpu]++;
+        }
+        if (p->slot) {
+            ownJOBSLOT(p->slot, child_pid);
+        }
+        if (out[0] >= 0) {
+            close(out[1]);
+            // only the dispatcher's end is non-blocking; a process that
+            // fills the pipe waits for it without holding up anyone else
+            fcntl(out[0], F_SETFL, O_NONBLOCK);
+            fcntl(out[0], F_SETPIPE_SZ, LOG_PIPE_SIZE);
+            p->out_fd = out[0];
+            insertDA(capturing, p);
+        }
+        char stat_path[64];
+        snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", (int)child_pid);
+        p->stat_fd = open(stat_path, O_RDONLY | O_CLOEXEC);
+#ifdef SYS_pidfd_open
+        p->pidfd = syscall(SYS_pidfd_open, child_pid, 0);
+#endif
     }
 }
 
-void terminateProcess(process *p) {
-    kill(p->pid, SIGINT);
-    waitpid(p->pid, NULL, WUNTRACED);
+// Picks the CPU a process is to run on under --affinity: the one it last ran
+// on, whose cache may still hold its working set, unless that is home to
+// opts.affinity more processes than the CPU with the fewest, or may not be
+// used; then the one with the fewest. One starting has run nowhere yet.
+// Returns the CPU.
+
+int choose_cpu(process *p) {
+    int best = -1, i;
+    // the process's own home doesn't count against it
+    for (i = 0; i < num_cpus; i++) {
+        if (CPU_ISSET(i, &allowed_cpus)
+            && (best < 0 || cpu_homes[i] - (p->home == i) < cpu_homes[best] - (p->home == best))) {
+            best = i;
+        }
+    }
+    int last = p->last_cpu;
+    if (last >= 0 && last < num_cpus && CPU_ISSET(last, &allowed_cpus)
+        && (cpu_homes[last] - (p->home == last)) - (cpu_homes[best] - (p->home == best))
+           < opts.affinity) {
+        return last;
+    }
+    return best;
 }
 
-void suspendProcess(process *p) {
-    kill(p->pid, SIGTSTP);
-    waitpid(p->pid, NULL, WUNTRACED);
-    if (p->priority != 3) {
-        p->priority++;
+// Pins a process to a CPU, making that its home. Only the process the
+// dispatcher started is pinned; anything it has started since keeps its own
+// affinity.
+
+void pin_process(process *p, int cpu) {
+    if (cpu < 0 || cpu == p->home) {
+        return;
     }
-    p->state = waiting;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(p->pid, sizeof(set), &set) < 0) {
+        return;
+    }
+    if (p->home >= 0) {
+        cpu_homes[p->home]--;
+    }
+    p->home = cpu;
+    cpu_homes[cpu]++;
 }
 
-void restartProcess(process *p) {
-    kill(p->pid, SIGCONT);
+// A parked process is neither stopped nor frozen: SIGINT ends its wait, and
+// cgroup.kill works as ever. A stopped one is continued to take the SIGINT,
+// once a pipelined stop has been confirmed so that it isn't waited for later.
+
+void terminate_os(process *p) {
+    if (p->stop_us >= 0) {
+        confirm_stop(p);
+    }
+    if (p->exited) {
+        reap_process(p, 1);
+        return;
+    }
+    if (!p->cg || killCGROUP(p->cg) < 0) {
+        kill(-p->pid, SIGINT);
+        kill(-p->pid, SIGCONT);
+    }
+    reap_process(p, 1);
+}
+
+void suspend_os(process *p) {
+    int64_t t = elapsed_us();
+    if (p->exited) {
+        return;
+    }
+    if (yield_process(p)) {
+        sample_cpu(p);
+    } else {
+        if (p->cg) {
+            freezeCGROUP(p->cg);
+        } else {
+            // an adopted process's group is orphaned, and ignores SIGTSTP
+            kill(-p->pid, p->adopted ? SIGSTOP : SIGTSTP);
+        }
+        if (opts.pipelined) {
+            p->stop_us = t;
+            insertDA(stopping, p);
+        } else {
+            wait_stopped(p, 1);
+            stats.stops++;
+            stats.stop_us += elapsed_us() - t;
+            sample_cpu(p);
+        }
+    }
+}
+
+void restart_os(process *p) {
+    // one that exited while stopping is found to have at the next check
+    if (p->exited) {
+        return;
+    }
+    if (opts.affinity) {
+        // stopped, it shows the CPU it last ran on
+        sample_cpu(p);
+        int cpu = choose_cpu(p);
+        if (cpu == p->last_cpu) {
+            stats.kept_cpu++;
+        } else {
+            stats.moved_cpu++;
+        }
+        pin_process(p, cpu);
+    }
+    if (p->parked) {
+        p->parked = 0;
+        resumeJOBSLOT(p->slot);
+        return;
+    }
+    if (p->stop_us >= 0) {
+        confirm_stop(p);
+    }
+    if (p->cg) {
+        thawCGROUP(p->cg);
+    }
+    if (!p->cg || p->sigstopped) {
+        p->sigstopped = 0;
+        kill(-p->pid, SIGCONT);
+    }
 }
 
+// Fibers are only ever suspended, resumed or ended between slices, when
+// they have yielded, so only starting and ending them takes any work.
 
-DA *get_procs_with_arrival_time(CDA *dq, int arrival_time) {
-    DA *proc_list = newDA(display_proc);
-    int i;
-    for (i = 0; i < sizeCDA(dq); i++) {
-        process *curr_proc = (process *)getCDA(dq, i);
-        if (curr_proc->arrival_time == arrival_time) {
-            insertDA(proc_list, curr_proc);
+void start_fiber(process *p) {
+    FIBERTASK task = findFIBERTASK(p->cmd->argv[0]);
+    if (!task) {
+        // ends at its first slice, as a process that can't exec would
+        fprintf(stderr, "%s: no such fiber task\n", p->cmd->argv[0]);
+        return;
+    }
+    p->fiber = newFIBER(task, p->cmd->argc, p->cmd->argv);
+}
+
+void terminate_fiber(process *p) {
+    if (p->fiber) {
+        freeFIBER(p->fiber);
+        p->fiber = 0;
+    }
+}
+
+// Runs the fiber holding the CPU for one slice, which stands for the tick:
+// fibers are preempted only where they yield. One whose task returns has
+// exited early, and is taken off the CPU at the next tick.
+
+void run_fiber(dispatcher *d, int64_t tick_end) {
+    process *r = d->currently_running;
+    virtual_us = tick_end;
+    if (r && r->state != finished && (!r->fiber || resumeFIBER(r->fiber))) {
+        trace("exit job %d\n", r->id);
+        end_run(r);
+        terminate_fiber(r);
+        r->end_us = elapsed_us();
+        r->state = finished;
+        r->proc_time = 0;
+        stats.early_exits++;
+    }
+}
+
+// What a backend does when it has nothing to do.
+
+void no_op(process *p) {
+}
+
+
+// Reads the optional fields that may come between PROC_TIME and the command,
+// text being what follows PROC_TIME's comma: a deadline, a number of seconds
+// after arrival, and the processes to wait for, "@ID ID ...". Each ends the
+// line or is followed by a comma. Sets deadline to -1 and deps to NULL for
+// those not given. Returns the command, or NULL if the line ends first.
+
+const char *parse_fields(const char *text, double *deadline, const char **deps) {
+    *deadline = -1;
+    *deps = 0;
+    for (;;) {
+        const char *end = text + strcspn(text, ",\n");
+        double value;
+        int len = 0;
+        if (*text == '@' && !*deps) {
+            *deps = text + 1;
+        } else if (*deadline == -1 && sscanf(text, "%lf%n", &value, &len) == 1
+                   && text + len + strspn(text + len, " \t\r") == end) {
+            // a deadline of -1 would read as none
+            *deadline = value == -1 ? 0 : value;
+        } else {
+            return text;
+        }
+        if (*end != ',') {
+            return 0;
+        }
+        text = end + 1;
+    }
+}
+
+// Expires the timers due by t: takes the pending processes that have arrived
+// off the wheel, and traces the live ones that have reached their deadline.
+// Returns the arrival timers of the processes, linked through next in
+// dispatch-list order, not arrival order, as that is the order they join
+// their run queues in. The list lives in the timers themselves, so a tick
+// allocates nothing to admit however many arrive.
+
+TIMER *get_procs_with_arrival_time(dispatcher *d, int64_t t) {
+    TIMER *arrived = 0;
+    TIMER *timer, *next;
+    for (timer = expireWHEEL(d->timers, t); timer; timer = next) {
+        next = timer->next;
+        process *p = (process *)timer->data;
+        if (timer == &p->arrival_timer) {
+            timer->next = arrived;
+            arrived = timer;
+        } else {
+            trace("miss job %d\n", p->id);
+        }
+    }
+    return sort_by_id(arrived);
+}
+
+// Puts a process on the wheel to arrive. Cancelling it takes it off again.
+
+void add_arrival(dispatcher *d, process *p) {
+    addWHEEL(d->timers, &p->arrival_timer, p->arrival_us);
+}
+
+// Returns a time before which no process arrives and no deadline passes,
+// the next such event if the wheel has got it down to the microsecond, or
+// -1 if there are none.
+
+int64_t next_arrival(dispatcher *d) {
+    return nextWHEEL(d->timers);
+}
+
+// Puts a ready process on a heap.
+
+void heap_push(heap *h, process *p) {
+    if (h->size == h->cap) {
+        h->cap = h->cap ? h->cap * 2 : 64;
+        h->arr = realloc(h->arr, sizeof(process *) * h->cap);
+        assert(h->arr != 0);
+    }
+    heap_place(h, h->size++, p);
+}
+
+// Makes room on a heap for cap processes, so that it doesn't reallocate
+// until it holds more.
+
+void heap_reserve(heap *h, int cap) {
+    if (h->cap < cap) {
+        h->cap = cap;
+        h->arr = realloc(h->arr, sizeof(process *) * h->cap);
+        assert(h->arr != 0);
+    }
+}
+
+// Removes and returns the first process on the heap.
+
+process *heap_pop(heap *h) {
+    process *first = h->arr[0];
+    heap_remove(h, first);
+    return first;
+}
+
+// Takes p out of the heap, wherever it is.
+
+void heap_remove(heap *h, process *p) {
+    int i = p->heap_index;
+    process *last = h->arr[--h->size];
+    p->heap_index = -1;
+    if (last != p) {
+        heap_place(h, i, last);
+    }
+}
+
+// Puts p in the empty slot i and moves it up or down to where it belongs,
+// keeping the position of every process it passes up to date. This is also
+// how a process whose remaining time changed would be moved.
+
+void heap_place(heap *h, int i, process *p) {
+    while (i > 0 && h->compare(p, h->arr[(i - 1) / 2]) < 0) {
+        h->arr[i] = h->arr[(i - 1) / 2];
+        h->arr[i]->heap_index = i;
+        i = (i - 1) / 2;
+    }
+    int child;
+    while ((child = 2 * i + 1) < h->size) {
+        if (child + 1 < h->size && h->compare(h->arr[child + 1], h->arr[child]) < 0) {
+            child++;
         }
+        if (h->compare(p, h->arr[child]) <= 0) {
+            break;
+        }
+        h->arr[i] = h->arr[child];
+        h->arr[i]->heap_index = i;
+        i = child;
+    }
+    h->arr[i] = p;
+    p->heap_index = i;
+}
+
+// Orders processes by remaining time, then by position in the dispatch list.
+
+int compare_remaining(process *a, process *b) {
+    if (a->proc_time != b->proc_time) {
+        return a->proc_time - b->proc_time;
+    }
+    return a->id - b->id;
+}
+
+// Orders processes by deadline, then by position in the dispatch list.
+
+int compare_deadlines(process *a, process *b) {
+    if (a->deadline_us != b->deadline_us) {
+        return a->deadline_us < b->deadline_us ? -1 : 1;
+    }
+    return a->id - b->id;
+}
+
+// Merge sorts a list of timers, linked through next, by the id of their
+// processes. Returns the first.
+
+TIMER *sort_by_id(TIMER *list) {
+    if (!list || !list->next) {
+        return list;
+    }
+    TIMER *slow = list, *fast = list->next;
+    while (fast && fast->next) {
+        slow = slow->next;
+        fast = fast->next->next;
     }
-    return proc_list;
+    TIMER *a = sort_by_id(slow->next), *b;
+    slow->next = 0;
+    b = sort_by_id(list);
+    TIMER *first = 0, **tail = &first;
+    while (a && b) {
+        TIMER **lower = ((process *)a->data)->id < ((process *)b->data)->id ? &a : &b;
+        *tail = *lower;
+        tail = &(*lower)->next;
+        *lower = (*lower)->next;
+    }
+    *tail = a ? a : b;
+    return first;
 }
 
-process *new_proc(int arrival_time, int priority, int proc_time) {
+process *new_proc(double arrival_time, int priority, int proc_time) {
     process *np = malloc(sizeof(process));
-    np->arrival_time = arrival_time;
+    np->arrival_time = (int)arrival_time;
     np->priority = priority;
     np->proc_time = proc_time;
     np->pid = 0;
-    np->state = ready;
+    np->state = pending;
+    np->arrival_us = (int64_t)(arrival_time * USEC_PER_SEC);
+    np->start_us = -1;
+    np->end_us = -1;
+    np->stop_us = -1;
+    np->cg = 0;
+    np->service_time = proc_time;
+    np->ticks = 0;
+    np->cpu_us = 0;
+    np->stat_fd = -1;
+    np->pidfd = -1;
+    np->resumed_us = -1;
+    np->slot = 0;
+    np->parked = 0;
+    np->id = 0;
+    np->out_fd = -1;
+    np->log = 0;
+    np->cmd = default_command;
+    np->fiber = 0;
+    np->heap_index = -1;
+    np->deadline_us = -1;
+    np->edf = 0;
+    np->density = 0;
+    np->waiting_on = 0;
+    np->dependents = 0;
+    np->num_dependents = np->dependents_cap = 0;
+    np->critical = 0;
+    initTIMER(&np->arrival_timer, np);
+    initTIMER(&np->deadline_timer, np);
+    np->pid_start = 0;
+    np->adopted = 0;
+    np->deferred = 0;
+    np->last_cpu = -1;
+    np->home = -1;
+    np->sigstopped = 0;
+    np->exited = 0;
     return np;
 }
 
@@ -275,6 +3795,7 @@ CDA *newCDA(void (*d)(FILE *, void *)) {
     cda->arr = (void **)malloc(cda->cap * sizeof(void *));
     assert(cda->arr != 0);
     cda->display = d;
+    cda->reserved = 0;
     return cda;
 }
 
@@ -314,7 +3835,7 @@ void insertCDAback(CDA *items, void *value) {
 
 void *removeCDAfront(CDA *items) {
     assert(items->size > 0);
-    if (items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
+    if (!items->reserved && items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
         CDAreduceCap(items);
     }
     void *front = items->arr[items->front];
@@ -329,7 +3850,7 @@ void *removeCDAfront(CDA *items) {
 
 void *removeCDAback(CDA *items) {
     assert(items->size > 0);
-    if (items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
+    if (!items->reserved && items->cap > 1 && (items->size - 1) / (float) items->cap < 0.25) {
         CDAreduceCap(items);
     }
     int b = (items->front - 1 + items->size) % items->cap;
@@ -405,6 +3926,19 @@ void **extractCDA(CDA *items) {
     return arr;
 }
 
+// Function: reserveCDA
+// Takes in a CDA object and a capacity
+// Grows the array to hold at least that many items, and stops it shrinking
+//     from then on, so that a CDA filled and emptied over and over stops
+//     allocating once it has grown to the most it holds.
+
+void reserveCDA(CDA *items, int cap) {
+    while (items->cap < cap) {
+        CDAincreaseCap(items);
+    }
+    items->reserved = 1;
+}
+
 // Function: sizeCDA
 // Takes in a CDA object
 // Returns the size of the CDA
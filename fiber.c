@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fiber.h"
+
+#define STACK_SIZE (64 * 1024) // Usable stack per fiber, above a guard page
+#define DEFAULT_SPIN 1000
+
+struct fiber {
+    ucontext_t context;
+    FIBERTASK task;
+    int argc;
+    char **argv;
+    char *stack; // Guard page, then STACK_SIZE bytes
+    int done; // Set once the task has returned
+    FIBER *next_free;
+};
+
+typedef struct task_struct {
+    const char *name;
+    FIBERTASK task;
+} TASK;
+
+static ucontext_t caller; // Where the running fiber yields back to
+static FIBER *current; // The running fiber, or 0
+static FIBER *free_fibers; // Freed fibers, stacks and all
+static long long switches;
+static volatile unsigned sink; // Keeps the busy work from being optimised out
+
+static void trampoline(void);
+static void work(long steps);
+static void spinTask(FIBER *f,int argc,char **argv);
+static void yieldTask(FIBER *f,int argc,char **argv);
+static void countTask(FIBER *f,int argc,char **argv);
+
+static const TASK tasks[] = {
+    { "spin", spinTask },
+    { "yield", yieldTask },
+    { "count", countTask },
+    { 0, 0 }
+};
+
+// Function: findFIBERTASK
+// Takes in the name of a built-in task
+// Returns the task, or NULL if there is none by that name.
+
+FIBERTASK findFIBERTASK(const char *name) {
+    const TASK *t;
+    for (t = tasks; t->name; t++) {
+        if (strcmp(t->name, name) == 0) {
+            return t->task;
+        }
+    }
+    return 0;
+}
+
+// Function: newFIBER
+// Takes in a task and the arguments to call it with, which must outlive the
+//     fiber
+// Sets up a fiber that will call the task when first resumed, reusing a
+//     freed one if there is one.
+// Returns the new FIBER.
+
+FIBER *newFIBER(FIBERTASK task, int argc, char **argv) {
+    FIBER *f = free_fibers;
+    if (f) {
+        free_fibers = f->next_free;
+    } else {
+        long page = sysconf(_SC_PAGESIZE);
+        f = (FIBER *)malloc(sizeof(FIBER));
+        assert(f != 0);
+        f->stack = mmap(0, STACK_SIZE + page, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        assert(f->stack != MAP_FAILED);
+        // an overflow faults rather than running into other memory
+        mprotect(f->stack, page, PROT_NONE);
+    }
+    f->task = task;
+    f->argc = argc;
+    f->argv = argv;
+    f->done = 0;
+    getcontext(&f->context);
+    f->context.uc_stack.ss_sp = f->stack;
+    f->context.uc_stack.ss_size = STACK_SIZE + sysconf(_SC_PAGESIZE);
+    f->context.uc_link = &caller;
+    makecontext(&f->context, trampoline, 0);
+    return f;
+}
+
+// Function: resumeFIBER
+// Takes in a FIBER whose task hasn't returned
+// Runs it until it yields or its task returns.
+// Returns 1 if the task has returned, 0 if it yielded.
+
+int resumeFIBER(FIBER *f) {
+    assert(!f->done && !current);
+    current = f;
+    switches += 2;
+    swapcontext(&caller, &f->context);
+    current = 0;
+    return f->done;
+}
+
+// Function: yieldFIBER
+// Takes in the running FIBER; only its task may call this
+// Switches back to whoever resumed it, until it is resumed again.
+// Returns nothing.
+
+void yieldFIBER(FIBER *f) {
+    swapcontext(&f->context, &caller);
+}
+
+// Function: switchesFIBER
+// Takes in nothing
+// Returns the number of context switches into and out of fibers so far.
+
+long long switchesFIBER(void) {
+    return switches;
+}
+
+// Function: freeFIBER
+// Takes in a FIBER that isn't running; its task need not have returned
+// Keeps the fiber for reuse. A task cut short holds nothing to release.
+// Returns nothing.
+
+void freeFIBER(FIBER *f) {
+    f->next_free = free_fibers;
+    free_fibers = f;
+}
+
+// Static function: trampoline
+// Takes in nothing; makecontext() can only pass ints portably, so the fiber
+//     is found through current
+// Calls the task, then marks the fiber done and returns through uc_link to
+//     the caller.
+// Returns nothing.
+
+static void trampoline(void) {
+    FIBER *f = current;
+    f->task(f, f->argc, f->argv);
+    f->done = 1;
+}
+
+// Static function: work
+// Takes in a number of steps
+// Does that many steps of arithmetic, standing in for a job's work.
+// Returns nothing.
+
+static void work(long steps) {
+    unsigned x = sink;
+    long i;
+    for (i = 0; i < steps; i++) {
+        x = x * 1103515245 + 12345;
+    }
+    sink = x;
+}
+
+// Static function: spinTask
+// The "spin [N]" task: N steps of work per slice, until terminated.
+
+static void spinTask(FIBER *f, int argc, char **argv) {
+    long steps = argc > 1 ? atol(argv[1]) : DEFAULT_SPIN;
+    for (;;) {
+        work(steps);
+        yieldFIBER(f);
+    }
+}
+
+// Static function: yieldTask
+// The "yield" task: no work, just yields, until terminated.
+
+static void yieldTask(FIBER *f, int argc, char **argv) {
+    for (;;) {
+        yieldFIBER(f);
+    }
+}
+
+// Static function: countTask
+// The "count N" task: N slices of work, then it returns.
+
+static void countTask(FIBER *f, int argc, char **argv) {
+    long slices = argc > 1 ? atol(argv[1]) : 1;
+    long i;
+    for (i = 0; i < slices; i++) {
+        if (i > 0) {
+            yieldFIBER(f);
+        }
+        work(DEFAULT_SPIN);
+    }
+}
@@ -0,0 +1,31 @@
+/****************************************************************\
+ * FILE: fiber.h
+ * This is the header file for the fiber module.
+ * A FIBER runs a task, a C function, on its own stack inside the
+ * dispatcher. The dispatcher resumes it for a slice and it runs until
+ * it yields or returns, so switching jobs costs a pair of context
+ * switches rather than a fork, an exec and signals. Fibers and their
+ * stacks are kept for reuse once freed.
+ *
+ * The tasks are built in and looked up by name:
+ *
+ *   spin [N]   N steps of busy work (default 1000) per slice, forever
+ *   yield      no work at all, so slices measure the switch alone
+ *   count N    a slice of busy work N times, then return
+\****************************************************************/
+
+#ifndef __FIBER_INCLUDED__
+#define __FIBER_INCLUDED__
+
+typedef struct fiber FIBER;
+
+typedef void (*FIBERTASK)(FIBER *f,int argc,char **argv);
+
+extern FIBERTASK findFIBERTASK(const char *name);
+extern FIBER *newFIBER(FIBERTASK task,int argc,char **argv);
+extern int resumeFIBER(FIBER *f);
+extern void yieldFIBER(FIBER *f);
+extern long long switchesFIBER(void);
+extern void freeFIBER(FIBER *f);
+
+#endif
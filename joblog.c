@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "joblog.h"
+
+#define PATH_SIZE 512
+#define OLD_PATH_SIZE (PATH_SIZE + 2) // Room for ".1"
+#define COPY_SIZE 65536 // Chunk size when splice() can't be used
+
+struct joblog {
+    char path[PATH_SIZE];
+    char old[OLD_PATH_SIZE];
+    int fd;
+    long long max; // Size at which the file is rotated, or 0 for no limit
+    long long size; // Bytes in the current file
+    long long total; // Bytes logged over all files
+    int copy; // Set once splice() has failed for this file
+};
+
+static int openLog(JOBLOG *log);
+static int rotateLog(JOBLOG *log);
+static ssize_t copyChunk(int from,int to,size_t len);
+
+// Function: newJOBLOG
+// Takes in the path of the log file and the size in bytes at which it is
+//     rotated, 0 for none.
+// Creates (or truncates) the file. It isn't opened with O_APPEND, which
+//     splice() doesn't support.
+// Returns the new JOBLOG, or NULL with errno set if the file can't be opened.
+
+JOBLOG *newJOBLOG(const char *path, long long max_bytes) {
+    JOBLOG *log = (JOBLOG *)malloc(sizeof(JOBLOG));
+    assert(log != 0);
+    if (snprintf(log->path, PATH_SIZE, "%s", path) >= PATH_SIZE) {
+        free(log);
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    snprintf(log->old, OLD_PATH_SIZE, "%s.1", log->path);
+    log->max = max_bytes;
+    log->total = 0;
+    log->copy = 0;
+    if (openLog(log) < 0) {
+        free(log);
+        return 0;
+    }
+    return log;
+}
+
+// Function: pathJOBLOG
+// Takes in a JOBLOG
+// Returns the path of its current file.
+
+const char *pathJOBLOG(JOBLOG *log) {
+    return log->path;
+}
+
+// Function: spliceJOBLOG
+// Takes in a JOBLOG, the non-blocking read end of a pipe and a budget
+// Moves at most budget bytes from the pipe to the log, rotating the file
+//     whenever it fills up, so that one chatty job can't hold up the caller.
+// Returns the number of bytes moved; 0 if the pipe's write end has been
+//     closed and the pipe is empty; or -1 with errno set, EAGAIN if there
+//     was nothing to move.
+
+ssize_t spliceJOBLOG(JOBLOG *log, int pipe_fd, size_t budget) {
+    size_t moved = 0;
+    while (moved < budget) {
+        if (log->max > 0 && log->size >= log->max && rotateLog(log) < 0) {
+            break;
+        }
+        size_t len = budget - moved;
+        if (log->max > 0 && (long long)len > log->max - log->size) {
+            len = log->max - log->size;
+        }
+        ssize_t n = -1;
+        if (!log->copy) {
+            n = splice(pipe_fd, 0, log->fd, 0, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            // some file systems can't be spliced into; copy from then on
+            if (n < 0 && errno == EINVAL) {
+                log->copy = 1;
+            }
+        }
+        if (log->copy) {
+            n = copyChunk(pipe_fd, log->fd, len);
+        }
+        if (n <= 0) {
+            if (moved > 0) {
+                break;
+            }
+            return n;
+        }
+        moved += n;
+        log->size += n;
+        log->total += n;
+    }
+    return moved;
+}
+
+// Function: bytesJOBLOG
+// Takes in a JOBLOG
+// Returns the number of bytes logged to it, rotated files included.
+
+long long bytesJOBLOG(JOBLOG *log) {
+    return log->total;
+}
+
+// Function: freeJOBLOG
+// Takes in a JOBLOG
+// Closes the file and frees the JOBLOG.
+// Returns 0, or -1 with errno set if closing failed.
+
+int freeJOBLOG(JOBLOG *log) {
+    int rc = close(log->fd);
+    int saved = errno;
+    free(log);
+    errno = saved;
+    return rc;
+}
+
+// Static function: openLog
+// Takes in a JOBLOG
+// Starts a new, empty file at its path.
+// Returns 0, or -1 with errno set.
+
+static int openLog(JOBLOG *log) {
+    log->fd = open(log->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    log->size = 0;
+    return log->fd < 0 ? -1 : 0;
+}
+
+// Static function: rotateLog
+// Takes in a full JOBLOG
+// Renames the file to the ".1" path, replacing the last one, and starts a
+//     new file.
+// Returns 0, or -1 with errno set, in which case the log keeps growing.
+
+static int rotateLog(JOBLOG *log) {
+    int fd = log->fd;
+    if (rename(log->path, log->old) < 0 || openLog(log) < 0) {
+        log->fd = fd;
+        log->max = 0;
+        return -1;
+    }
+    close(fd);
+    log->copy = 0;
+    return 0;
+}
+
+// Static function: copyChunk
+// Takes in a non-blocking pipe, a file and a length
+// Moves up to len bytes, but no more than COPY_SIZE, through a buffer.
+// Returns what read() returned, or -1 if the write failed.
+
+static ssize_t copyChunk(int from, int to, size_t len) {
+    static char buf[COPY_SIZE];
+    ssize_t n = read(from, buf, len < COPY_SIZE ? len : COPY_SIZE);
+    if (n > 0 && write(to, buf, n) != n) {
+        return -1;
+    }
+    return n;
+}
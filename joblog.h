@@ -0,0 +1,23 @@
+/****************************************************************\
+ * FILE: joblog.h
+ * This is the header file for the job log module.
+ * A JOBLOG is a log file that job output is spliced into straight
+ * from the job's pipe, without passing through user space. Once it
+ * reaches its size limit it is rotated: the file is renamed with a
+ * ".1" suffix, replacing the previous one, and a new file started.
+\****************************************************************/
+
+#ifndef __JOBLOG_INCLUDED__
+#define __JOBLOG_INCLUDED__
+
+#include <sys/types.h>
+
+typedef struct joblog JOBLOG;
+
+extern JOBLOG *newJOBLOG(const char *path,long long max_bytes);
+extern const char *pathJOBLOG(JOBLOG *log);
+extern ssize_t spliceJOBLOG(JOBLOG *log,int pipe_fd,size_t budget);
+extern long long bytesJOBLOG(JOBLOG *log);
+extern int freeJOBLOG(JOBLOG *log);
+
+#endif
@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "jobshm.h"
+
+#define RING_SIZE 256 // Events per slot; a power of two
+#define CACHE_LINE 64
+#define SLOT_FREE 0
+#define SLOT_CLAIMED -1 // Claimed by the dispatcher, pid not known yet
+
+enum control { RUN, YIELD, PARKED }; // Values of a slot's control word
+
+struct jobslot {
+    _Alignas(CACHE_LINE) _Atomic int32_t pid; // Owner, or SLOT_FREE
+    _Alignas(CACHE_LINE) _Atomic uint32_t head; // Written by the job only
+    _Atomic uint32_t dropped; // Events lost because the ring was full
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail; // Written by the dispatcher only
+    _Alignas(CACHE_LINE) _Atomic uint32_t control; // Futex word for yielding
+    _Atomic uint32_t cooperative; // Set while the job follows the protocol
+    JOBEVENT events[RING_SIZE];
+};
+
+struct jobshm {
+    int fd;
+    int slots;
+    JOBSLOT *base; // The mapping: a header page, then the slots
+};
+
+typedef struct header_struct {
+    int32_t slots;
+} header;
+
+static size_t headerSize(void);
+static int futexWait(_Atomic uint32_t *word,uint32_t value,int timeout_ms);
+static void futexWake(_Atomic uint32_t *word);
+static int64_t nowMs(void);
+
+// Function: newJOBSHM
+// Takes in the number of slots.
+// Creates an anonymous shared-memory segment whose descriptor survives exec,
+//     so that jobs can attach to it.
+// Returns the new JOBSHM, or NULL if the segment can't be created.
+
+JOBSHM *newJOBSHM(int slots) {
+    int fd = memfd_create("jobshm", 0);
+    if (fd < 0) {
+        return 0;
+    }
+    size_t size = headerSize() + slots * sizeof(JOBSLOT);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return 0;
+    }
+    void *map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    ((header *)map)->slots = slots; // the rest is zero, i.e. free and empty
+    JOBSHM *shm = (JOBSHM *)malloc(sizeof(JOBSHM));
+    assert(shm != 0);
+    shm->fd = fd;
+    shm->slots = slots;
+    shm->base = (JOBSLOT *)((char *)map + headerSize());
+    return shm;
+}
+
+// Function: attachJOBSHM
+// Takes in the descriptor of a segment made by newJOBSHM.
+// Maps it into the calling process.
+// Returns the JOBSHM, or NULL if it can't be mapped.
+
+JOBSHM *attachJOBSHM(int fd) {
+    header *h = mmap(0, headerSize(), PROT_READ, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        return 0;
+    }
+    int slots = h->slots;
+    munmap(h, headerSize());
+    void *map = mmap(0, headerSize() + slots * sizeof(JOBSLOT), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    JOBSHM *shm = (JOBSHM *)malloc(sizeof(JOBSHM));
+    assert(shm != 0);
+    shm->fd = fd;
+    shm->slots = slots;
+    shm->base = (JOBSLOT *)((char *)map + headerSize());
+    return shm;
+}
+
+// Function: fdJOBSHM
+// Takes in a JOBSHM
+// Returns the segment's file descriptor.
+
+int fdJOBSHM(JOBSHM *shm) {
+    return shm->fd;
+}
+
+// Function: sizeJOBSHM
+// Takes in a JOBSHM
+// Returns the number of slots.
+
+int sizeJOBSHM(JOBSHM *shm) {
+    return shm->slots;
+}
+
+// Function: getJOBSLOT
+// Takes in a JOBSHM and an index
+// Returns the slot at that index.
+
+JOBSLOT *getJOBSLOT(JOBSHM *shm, int index) {
+    assert(index >= 0 && index < shm->slots);
+    return &shm->base[index];
+}
+
+// Function: claimJOBSLOT
+// Takes in a JOBSHM
+// Marks a free slot as claimed and empties it. Used by the dispatcher before
+//     it starts a job.
+// Returns the slot, or NULL if all of them are in use.
+
+JOBSLOT *claimJOBSLOT(JOBSHM *shm) {
+    for (int i = 0; i < shm->slots; i++) {
+        JOBSLOT *slot = &shm->base[i];
+        int32_t expected = SLOT_FREE;
+        if (atomic_compare_exchange_strong(&slot->pid, &expected, SLOT_CLAIMED)) {
+            atomic_store(&slot->head, 0);
+            atomic_store(&slot->tail, 0);
+            atomic_store(&slot->dropped, 0);
+            atomic_store(&slot->control, RUN);
+            atomic_store(&slot->cooperative, 0);
+            return slot;
+        }
+    }
+    return 0;
+}
+
+// Function: ownJOBSLOT
+// Takes in a claimed slot and the pid of the job it is for.
+// Records the owner so the job can find its slot. Async-signal-safe.
+
+void ownJOBSLOT(JOBSLOT *slot, pid_t pid) {
+    atomic_store(&slot->pid, pid);
+}
+
+// Function: findJOBSLOT
+// Takes in a JOBSHM and a pid
+// Returns the slot owned by that pid, or NULL if there is none.
+
+JOBSLOT *findJOBSLOT(JOBSHM *shm, pid_t pid) {
+    for (int i = 0; i < shm->slots; i++) {
+        if (atomic_load(&shm->base[i].pid) == pid) {
+            return &shm->base[i];
+        }
+    }
+    return 0;
+}
+
+// Function: releaseJOBSLOT
+// Takes in a slot
+// Frees the slot for another job; any events left in it are discarded.
+
+void releaseJOBSLOT(JOBSLOT *slot) {
+    atomic_store(&slot->pid, SLOT_FREE);
+}
+
+// Function: pushJOBEVENT
+// Takes in a slot, an event type and a value
+// Appends a timestamped event to the slot's ring. Never blocks: if the
+//     dispatcher has fallen behind and the ring is full, the event is
+//     counted as dropped instead. Async-signal-safe.
+// Returns 1 if the event was queued, 0 if it was dropped.
+
+int pushJOBEVENT(JOBSLOT *slot, int type, int value) {
+    uint32_t head = atomic_load_explicit(&slot->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&slot->tail, memory_order_acquire);
+    if (head - tail == RING_SIZE) {
+        atomic_fetch_add_explicit(&slot->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    JOBEVENT *e = &slot->events[head & (RING_SIZE - 1)];
+    e->time_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    e->pid = atomic_load_explicit(&slot->pid, memory_order_relaxed);
+    e->type = type;
+    e->value = value;
+    atomic_store_explicit(&slot->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// Function: drainJOBSLOT
+// Takes in a slot, a buffer and its capacity in events
+// Moves up to max of the oldest events in the ring into buf.
+// Returns the number of events moved.
+
+int drainJOBSLOT(JOBSLOT *slot, JOBEVENT *buf, int max) {
+    uint32_t tail = atomic_load_explicit(&slot->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&slot->head, memory_order_acquire);
+    int n = 0;
+    while (tail != head && n < max) {
+        buf[n++] = slot->events[tail & (RING_SIZE - 1)];
+        tail++;
+    }
+    atomic_store_explicit(&slot->tail, tail, memory_order_release);
+    return n;
+}
+
+// Function: drainJOBSHM
+// Takes in a JOBSHM, a buffer and its capacity in events
+// Drains the slots in use, in slot order, until buf is full. Only the
+//     process that claims and releases slots may drain them.
+// Returns the number of events moved.
+
+int drainJOBSHM(JOBSHM *shm, JOBEVENT *buf, int max) {
+    int n = 0;
+    for (int i = 0; i < shm->slots && n < max; i++) {
+        JOBSLOT *slot = &shm->base[i];
+        if (atomic_load_explicit(&slot->pid, memory_order_relaxed) != SLOT_FREE) {
+            n += drainJOBSLOT(slot, buf + n, max - n);
+        }
+    }
+    return n;
+}
+
+// Function: droppedJOBSLOT
+// Takes in a slot
+// Returns the number of events its job couldn't queue.
+
+unsigned droppedJOBSLOT(JOBSLOT *slot) {
+    return atomic_load(&slot->dropped);
+}
+
+// Function: cooperateJOBSLOT
+// Takes in a slot and whether its job follows the yield protocol
+// Called by the job: once set, the dispatcher may ask it to yield instead
+//     of stopping it with a signal. Cleared when the job exits, which also
+//     ends any wait for it to park.
+
+void cooperateJOBSLOT(JOBSLOT *slot, int cooperative) {
+    atomic_store(&slot->cooperative, cooperative);
+    if (!cooperative) {
+        futexWake(&slot->control);
+    }
+}
+
+// Function: cooperativeJOBSLOT
+// Takes in a slot
+// Returns whether its job follows the yield protocol.
+
+int cooperativeJOBSLOT(JOBSLOT *slot) {
+    return atomic_load(&slot->cooperative);
+}
+
+// Function: yieldJOBSLOT
+// Takes in a slot
+// Called by the dispatcher: asks the job to yield, waking it if it is
+//     waiting on its control word.
+
+void yieldJOBSLOT(JOBSLOT *slot) {
+    atomic_store(&slot->control, YIELD);
+    futexWake(&slot->control);
+}
+
+// Function: parkedJOBSLOT
+// Takes in a slot asked to yield and a timeout in milliseconds
+// Called by the dispatcher: waits for the job to park. If it hasn't by the
+//     timeout, or stops cooperating, the request is withdrawn so the job
+//     can be stopped some other way.
+// Returns 1 if the job has parked, 0 if the request was withdrawn.
+
+int parkedJOBSLOT(JOBSLOT *slot, int timeout_ms) {
+    int64_t deadline = nowMs() + timeout_ms;
+    for (;;) {
+        uint32_t control = atomic_load(&slot->control);
+        int left = deadline - nowMs();
+        if (control != YIELD || !atomic_load(&slot->cooperative) || left <= 0) {
+            break;
+        }
+        futexWait(&slot->control, YIELD, left);
+    }
+    uint32_t expected = YIELD;
+    if (atomic_compare_exchange_strong(&slot->control, &expected, RUN)) {
+        return 0;
+    }
+    return expected == PARKED;
+}
+
+// Function: resumeJOBSLOT
+// Takes in a slot whose job has parked
+// Called by the dispatcher: lets the job run again.
+
+void resumeJOBSLOT(JOBSLOT *slot) {
+    atomic_store(&slot->control, RUN);
+    futexWake(&slot->control);
+}
+
+// Function: yieldingJOBSLOT
+// Takes in a slot
+// Called by the job, between steps of its work.
+// Returns whether the dispatcher has asked it to yield.
+
+int yieldingJOBSLOT(JOBSLOT *slot) {
+    return atomic_load_explicit(&slot->control, memory_order_relaxed) == YIELD;
+}
+
+// Function: waitJOBSLOT
+// Takes in a slot and a timeout in milliseconds
+// Called by an idle job in place of sleeping: returns after the timeout, on
+//     a signal, or as soon as it is asked to yield.
+// Returns whether it has been asked to yield.
+
+int waitJOBSLOT(JOBSLOT *slot, int timeout_ms) {
+    futexWait(&slot->control, RUN, timeout_ms);
+    return yieldingJOBSLOT(slot);
+}
+
+// Function: parkJOBSLOT
+// Takes in a slot
+// Called by the job when asked to yield: tells the dispatcher it has
+//     parked and waits until it is resumed.
+// Returns 1 once resumed, 0 if no yield was asked for, and -1 if a signal
+//     arrived while parked.
+
+int parkJOBSLOT(JOBSLOT *slot) {
+    uint32_t expected = YIELD;
+    if (!atomic_compare_exchange_strong(&slot->control, &expected, PARKED)) {
+        return 0;
+    }
+    futexWake(&slot->control);
+    while (atomic_load(&slot->control) == PARKED) {
+        if (futexWait(&slot->control, PARKED, -1) < 0 && errno == EINTR) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+// Static function: headerSize
+// Returns the size of the segment header: one page, so the slots that
+//     follow are page aligned.
+
+static size_t headerSize(void) {
+    return sysconf(_SC_PAGESIZE);
+}
+
+// Static function: futexWait
+// Takes in a control word, the value it is expected to hold and a timeout
+//     in milliseconds, or -1 to wait indefinitely
+// Sleeps while the word holds value, across processes.
+// Returns 0 when woken, or -1 with errno set (EAGAIN if the word had already
+//     changed, ETIMEDOUT, EINTR).
+
+static int futexWait(_Atomic uint32_t *word, uint32_t value, int timeout_ms) {
+    struct timespec ts, *tsp = 0;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        tsp = &ts;
+    }
+    return syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, tsp, 0, 0);
+}
+
+// Static function: futexWake
+// Takes in a control word
+// Wakes every process waiting on it.
+
+static void futexWake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT32_MAX, 0, 0, 0);
+}
+
+// Static function: nowMs
+// Returns the monotonic clock in milliseconds.
+
+static int64_t nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
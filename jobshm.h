@@ -0,0 +1,55 @@
+/****************************************************************\
+ * FILE: jobshm.h
+ * This is the header file for the job shared-memory module.
+ * The dispatcher creates one segment with a slot per live job;
+ * each job reports tick, signal and state events into a lock-free
+ * single-producer ring in its slot, which the dispatcher drains in
+ * batches instead of the job writing to a shared stdout.
+ * A cooperative job can also be asked to yield through its slot: it
+ * parks on a futex until resumed, instead of being sent SIGTSTP and
+ * SIGCONT.
+\****************************************************************/
+
+#ifndef __JOBSHM_INCLUDED__
+#define __JOBSHM_INCLUDED__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define JOBSHM_FD_ENV "SIGTRAP_SHM_FD" // names the segment's fd in jobs
+
+enum jobevent_type { JOB_START, JOB_TICK, JOB_SIGNAL, JOB_EXIT, JOB_PARK, JOB_RESUME };
+
+typedef struct jobevent_struct {
+    int64_t time_us; // CLOCK_MONOTONIC, when the job logged the event
+    int32_t pid;
+    int16_t type; // a jobevent_type
+    int16_t value; // Tick count or signal number
+} JOBEVENT;
+
+typedef struct jobshm JOBSHM;
+typedef struct jobslot JOBSLOT;
+
+extern JOBSHM *newJOBSHM(int slots);
+extern JOBSHM *attachJOBSHM(int fd);
+extern int fdJOBSHM(JOBSHM *shm);
+extern int sizeJOBSHM(JOBSHM *shm);
+extern JOBSLOT *getJOBSLOT(JOBSHM *shm,int index);
+extern JOBSLOT *claimJOBSLOT(JOBSHM *shm);
+extern JOBSLOT *findJOBSLOT(JOBSHM *shm,pid_t pid);
+extern void ownJOBSLOT(JOBSLOT *slot,pid_t pid);
+extern void releaseJOBSLOT(JOBSLOT *slot);
+extern int pushJOBEVENT(JOBSLOT *slot,int type,int value);
+extern int drainJOBSLOT(JOBSLOT *slot,JOBEVENT *buf,int max);
+extern int drainJOBSHM(JOBSHM *shm,JOBEVENT *buf,int max);
+extern unsigned droppedJOBSLOT(JOBSLOT *slot);
+extern void cooperateJOBSLOT(JOBSLOT *slot,int cooperative);
+extern int cooperativeJOBSLOT(JOBSLOT *slot);
+extern void yieldJOBSLOT(JOBSLOT *slot);
+extern int parkedJOBSLOT(JOBSLOT *slot,int timeout_ms);
+extern void resumeJOBSLOT(JOBSLOT *slot);
+extern int yieldingJOBSLOT(JOBSLOT *slot);
+extern int waitJOBSLOT(JOBSLOT *slot,int timeout_ms);
+extern int parkJOBSLOT(JOBSLOT *slot);
+
+#endif
@@ -3,9 +3,34 @@
  
   usage:
  
-    sigtrap [n]
+    sigtrap [-l load] [-m kbytes] [-f file] [n]
      
     [n] is time for process to exist - default 20 seconds
+    [load] is what the process does during each tick - default idle:
+ 
+      idle   sleep
+      cpu    busy-spin
+      mem    stream reads and writes over a working set of [kbytes]
+      touch  touch fresh pages of a [kbytes] region, growing the
+             resident set, then release them and start again
+      io     write [kbytes] to [file] (default: an unlinked temporary
+             file) in 64k blocks, flushing it to disk each pass
+ 
+    the environment variables SIGTRAP_LOAD, SIGTRAP_KBYTES and
+    SIGTRAP_FILE set the same things, so a dispatcher can apply a load
+    to every process it starts. options override the environment.
+ 
+    if SIGTRAP_SHM_FD names a job shared-memory segment (jobshm.h)
+    holding a slot for this process, events are written to the slot's
+    ring instead of stdout, and echoed only if SIGTRAP_ECHO is set.
+    the process then also follows the slot's yield protocol: asked to
+    yield, it parks on a futex until resumed rather than waiting to be
+    sent SIGTSTP; idle processes wait on the futex instead of sleeping.
+
+    with the mem load the process reports, as it exits, how fast it
+    streamed over its working set per second of its own cpu time; a
+    working set that stays in cache between its turns on the cpu
+    streams faster.
    
   program ticks away reporting process id and tick count every
   second. the program traps and reports the following signals:
@@ -26,8 +51,14 @@
    date:    December 2003
    author:  Dr Ian G Graham, ian.graham@griffith.edu.au
    history: derived from original simple sleep process (Exercise 1)
+            load profiles added so dispatchers can be measured under
+            cpu, cache, memory and i/o pressure
+            mem load reports its throughput on exit
+            events optionally reported through shared memory
+            cooperative yield through shared memory
  
  *******************************************************************/
+#define _GNU_SOURCE                   // for sigabbrev_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,8 +68,12 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include <time.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include "jobshm.h"
  
 #ifndef TRUE
 #define TRUE 1
@@ -49,12 +84,37 @@
 #endif
  
 static void SignalHandler(int);
+static void Trap(int);               // hook up signal handler
 void        PrintUsage(char*);   // for error exit & info
 char       *StripPath(char*);    // strip path from filename
+static int  ParseLoad(char*);    // load name to load profile
+static void SetupLoad(void);     // allocate what the load profile needs
+static int  Work(int);           // apply the load for a number of seconds
+static int  Signalled(void);     // true if a trapped signal is pending
+static void Report(FILE*, int, int); // report an event
+static void ReportExit(void);    // report the exit (atexit handler)
  
 #define DEFAULT_TIME 20
 #define DEFAULT_OP   stdout
 #define DEFAULT_NAME "sigtrap"
+#define DEFAULT_KBYTES (64 * 1024) // working set for mem, touch and io
+#define IO_BLOCK     (64 * 1024)
+ 
+enum load { IDLE, CPU, MEM, TOUCH, IO, N_LOAD };
+ 
+char * load_names [] = { "idle", "cpu", "mem", "touch", "io" };
+ 
+static int    load = IDLE;            // load profile and what it works on
+static size_t kbytes = DEFAULT_KBYTES;
+static char * io_file = NULL;
+static char * region = NULL;          // mem and touch working set
+static size_t touched = 0;            // bytes of region touched so far
+static int    io_fd = -1;
+static off_t  io_offset = 0;
+static long long passes = 0;          // mem passes over the working set
+ 
+static JOBSLOT * slot = NULL;         // shared-memory event ring, if any
+static int    echo = TRUE;            // also report events on stdout
  
 #define BLACK   "\033[30m"       // foreground colours
 #define RED     "\033[31m"
@@ -111,23 +171,55 @@ int main(int argc, char *argv[])
     clock_t starttick, stoptick;
     sigset_t mask;
     FILE * output = DEFAULT_OP;
+    JOBSHM * shm;
  
     colour = colours[pid % N_COLOUR]; // select colour for this process
-   
+ 
+    if (getenv("SIGTRAP_LOAD") && (load = ParseLoad(getenv("SIGTRAP_LOAD"))) < 0)
+        PrintUsage(argv[0]);
+    if (getenv("SIGTRAP_KBYTES"))
+        kbytes = strtoul(getenv("SIGTRAP_KBYTES"), NULL, 10);
+    io_file = getenv("SIGTRAP_FILE");
+ 
+    while ((rc = getopt(argc, argv, "l:m:f:")) != -1) {
+        switch (rc) {
+            case 'l':
+                if ((load = ParseLoad(optarg)) < 0) PrintUsage(argv[0]);
+                break;
+            case 'm':
+                kbytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                io_file = optarg;
+                break;
+            default:
+                PrintUsage(argv[0]);
+        }
+    }
+    argc -= optind - 1;               // leave [n] where it always was
+    argv += optind - 1;
     if (argc > 2 || (argc == 2 && !isdigit((int)argv[1][0])))
         PrintUsage(argv[0]);  
+    if (kbytes == 0) kbytes = 1;
+    SetupLoad();
+ 
+    if (getenv(JOBSHM_FD_ENV) && (shm = attachJOBSHM(atoi(getenv(JOBSHM_FD_ENV)))))
+        slot = findJOBSLOT(shm, pid);
+    echo = !slot || getenv("SIGTRAP_ECHO");
+    if (slot) cooperateJOBSLOT(slot, TRUE);
+    atexit(ReportExit);
    
-    fprintf(output,"%s%7d; START" BLACK NORMAL "\n", colour, (int) pid);
+    Report(output, JOB_START, 0);
     fflush(output);  
         
-    signal (SIGINT, SignalHandler);   // hook up signal handler
-    signal (SIGQUIT, SignalHandler);
-    signal (SIGHUP, SignalHandler);   
-    signal (SIGTERM, SignalHandler);
-    signal (SIGABRT, SignalHandler);
+    Trap (SIGINT);                    // hook up signal handler
+    Trap (SIGQUIT);
+    Trap (SIGHUP);   
+    Trap (SIGTERM);
+    Trap (SIGABRT);
 //  signal (SIGCONT, SignalHandler);  // do this intrinsically after return from SIGTSTP
                                       // due to Darwin/BSD inconsistent SIGCONT behaviour
-    signal (SIGTSTP, SignalHandler);
+    Trap (SIGTSTP);
                                            
     rc = setpriority(PRIO_PROCESS, 0, 20); // be nice, lower priority by 20
     cycle = argc < 2 ? DEFAULT_TIME : atoi(argv[1]);  // get tick count
@@ -137,51 +229,57 @@ int main(int argc, char *argv[])
  
         if (signal_SIGCONT) {
             signal_SIGCONT = FALSE;
-            fprintf(output,"%s%7d; SIGCONT" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGCONT);
             fflush(output);
         }
            
         starttick = times (&t);        // use timer to ascertain whether 'tick' should be
-        rc = sleep(1);                 //  reported
+        rc = Work(1);                  //  reported
         stoptick = times (&t);
         
         if (rc == 0 || (stoptick-starttick) > clktck/2)
-            fprintf(output,"%s%7d; tick %d" BLACK NORMAL "\n", colour, (int) pid, ++i);
+            Report(output, JOB_TICK, ++i);
                
         if (signal_SIGINT) {
-            fprintf(output,"%s%7d; SIGINT" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGINT);
             exit(0);
         }
         if (signal_SIGQUIT) {
-            fprintf(output,"%s%7d; SIGQUIT" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGQUIT);
             exit(0);
         }
         if (signal_SIGHUP) {
-            fprintf(output,"%s%7d; SIGHUP" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGHUP);
             exit(0);
         }
         if (signal_SIGTSTP) {
             signal_SIGTSTP = FALSE;
-            fprintf(output,"%s%7d; SIGTSTP" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGTSTP);
             fflush(output);
             sigemptyset (&mask);            // unblock SIGSTP if necessary (BSD/OS X)
             sigaddset (&mask, SIGTSTP);
             sigprocmask (SIG_UNBLOCK, &mask, NULL);
             signal(SIGTSTP, SIG_DFL);       // reset trap to default
             raise (SIGTSTP);                // now suspend ourselves
-            signal(SIGTSTP, SignalHandler); // reset trap on return from suspension
+            Trap(SIGTSTP);                  // reset trap on return from suspension
             signal_SIGCONT = TRUE;          // set flag here rather than trap signal
         }
         if (signal_SIGABRT) {
-            fprintf(output,"%s%7d; SIGABRT" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGABRT);
             fflush(output);
             signal (SIGABRT, SIG_DFL);
             raise (SIGABRT);
         }
         if (signal_SIGTERM) {
-            fprintf(output,"%s%7d; SIGTERM" BLACK NORMAL "\n", colour, (int) pid);
+            Report(output, JOB_SIGNAL, SIGTERM);
             exit(0);
         }               
+        if (slot && yieldingJOBSLOT(slot)) {
+            Report(output, JOB_PARK, i);
+            fflush(output);
+            if (parkJOBSLOT(slot) > 0)      // a signal ends the wait early; it
+                Report(output, JOB_RESUME, i); //  is handled next time round
+        }
         fflush(output);
     }
     exit(0);
@@ -228,6 +326,230 @@ static void SignalHandler(int sig)        // trap signals from shell/system
     }
 }
  
+/*******************************************************************
+ 
+  static void Trap(int sig)
+ 
+  hook up the signal handler for sig. with a slot, the signal must
+  interrupt a futex wait rather than have it restarted, as sleep()
+  always was.
+ *******************************************************************/
+ 
+static void Trap(int sig)
+{
+    struct sigaction sa;
+ 
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SignalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = slot ? 0 : SA_RESTART;
+    sigaction(sig, &sa, NULL);
+}
+ 
+/*******************************************************************
+ 
+  static int ParseLoad(char * name)
+ 
+  name - one of the load profile names
+ 
+  returns the load profile, or -1 if the name is not one
+ *******************************************************************/
+ 
+static int ParseLoad(char * name)
+{
+    int i;
+ 
+    for (i = 0; i < N_LOAD; i++)
+        if (strcmp(name, load_names[i]) == 0)
+            return i;
+    return -1;
+}
+ 
+/*******************************************************************
+ 
+  static void SetupLoad(void)
+ 
+  allocate the working set for the load profile. the mem region is
+  faulted in here so that ticks measure bandwidth rather than page
+  faults; the touch region is only reserved.
+ *******************************************************************/
+ 
+static void SetupLoad(void)
+{
+    char path[] = "/tmp/sigtrapXXXXXX";
+ 
+    switch (load) {
+        case MEM:
+        case TOUCH:
+            region = mmap(NULL, kbytes * 1024, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (region == MAP_FAILED) {
+                perror("sigtrap: mmap");
+                exit(1);
+            }
+            if (load == MEM)
+                memset(region, 1, kbytes * 1024);
+            break;
+        case IO:
+            if (io_file)
+                io_fd = open(io_file, O_WRONLY | O_CREAT, 0644);
+            else if ((io_fd = mkstemp(path)) >= 0)
+                unlink(path);
+            if (io_fd < 0) {
+                perror("sigtrap: open");
+                exit(1);
+            }
+            region = malloc(IO_BLOCK);
+            memset(region, 'x', IO_BLOCK);
+            break;
+    }
+}
+ 
+/*******************************************************************
+ 
+  static int Work(int seconds)
+ 
+  apply the load profile for the given number of seconds of elapsed
+  (times()) time, in small steps so that a trapped signal ends the
+  work as promptly as it interrupts sleep().
+ 
+  returns 0 if the full time was worked, otherwise the number of
+  seconds left, as sleep() does
+ *******************************************************************/
+ 
+static int Work(int seconds)
+{
+    long clktck = sysconf(_SC_CLK_TCK);
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = kbytes * 1024;
+    struct tms t;
+    clock_t start = times(&t), end = start + seconds * clktck;
+    volatile unsigned long spin = 0;
+    size_t i;
+    long *words = (long *) region;
+ 
+    if (load == IDLE && !slot)
+        return sleep(seconds);
+ 
+    while (times(&t) < end && !Signalled()) {
+        switch (load) {
+            case IDLE:                  // sleep, but wake when asked to yield
+                waitJOBSLOT(slot, (end - times(&t)) * 1000 / clktck + 1);
+                break;
+            case CPU:
+                for (i = 0; i < 100000; i++)
+                    spin += i;
+                break;
+            case MEM:                   // one pass over the working set
+                for (i = 0; i < size / sizeof(long); i += 8)
+                    words[i] = words[i] * 3 + 1;
+                passes++;
+                break;
+            case TOUCH:                 // fault in the next 256 pages
+                for (i = 0; i < 256; i++) {
+                    if (touched >= size) {
+                        madvise(region, size, MADV_DONTNEED);
+                        touched = 0;
+                    }
+                    region[touched] = 1;
+                    touched += page;
+                }
+                break;
+            case IO:
+                if (io_offset >= (off_t) size) {
+                    fdatasync(io_fd);
+                    io_offset = 0;
+                }
+                if (pwrite(io_fd, region, IO_BLOCK, io_offset) < 0) {
+                    perror("sigtrap: write");
+                    exit(1);
+                }
+                io_offset += IO_BLOCK;
+                break;
+        }
+    }
+    clock_t left = end - times(&t);
+    return left > 0 ? (left + clktck - 1) / clktck : 0;
+}
+ 
+/*******************************************************************
+ 
+  static int Signalled(void)
+ 
+  returns true if the signal handler has flagged a signal that the
+  main loop has still to act on, or the dispatcher has asked the
+  process to yield
+ *******************************************************************/
+ 
+static int Signalled(void)
+{
+    return signal_SIGINT || signal_SIGQUIT || signal_SIGHUP || signal_SIGTERM
+        || signal_SIGABRT || signal_SIGTSTP || (slot && yieldingJOBSLOT(slot));
+}
+ 
+/*******************************************************************
+ 
+  static void Report(FILE * output, int type, int value)
+ 
+  report an event: a jobevent_type and its tick count or signal
+  number. pushed to the shared-memory ring if there is one, which
+  never blocks, and printed in this process's colour if echoing.
+ *******************************************************************/
+ 
+static void Report(FILE * output, int type, int value)
+{
+    if (slot)
+        pushJOBEVENT(slot, type, value);
+    if (!echo)
+        return;
+    switch (type) {
+        case JOB_START:
+            fprintf(output,"%s%7d; START" BLACK NORMAL "\n", colour, (int) getpid());
+            break;
+        case JOB_TICK:
+            fprintf(output,"%s%7d; tick %d" BLACK NORMAL "\n", colour, (int) getpid(), value);
+            break;
+        case JOB_SIGNAL:
+            fprintf(output,"%s%7d; SIG%s" BLACK NORMAL "\n", colour, (int) getpid(),
+                    sigabbrev_np(value));
+            break;
+        case JOB_PARK:
+            fprintf(output,"%s%7d; PARK" BLACK NORMAL "\n", colour, (int) getpid());
+            break;
+        case JOB_RESUME:
+            fprintf(output,"%s%7d; RESUME" BLACK NORMAL "\n", colour, (int) getpid());
+            break;
+    }
+}
+ 
+/*******************************************************************
+ 
+  static void ReportExit(void)
+ 
+  report that the process is exiting; the exit is only pushed to the
+  ring, since stdout has always shown the last tick or signal instead.
+  the mem load's throughput is printed, though, as it is only known now.
+  the process stops cooperating, so the dispatcher doesn't wait for it
+  to park.
+ *******************************************************************/
+ 
+static void ReportExit(void)
+{
+    struct timespec cpu;
+
+    if (load == MEM && echo && clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu) == 0) {
+        double seconds = cpu.tv_sec + cpu.tv_nsec / 1e9;
+        printf("%s%7d; mem %.0f MB/s over %.3f s of cpu" BLACK NORMAL "\n", colour,
+               (int) getpid(), seconds > 0 ? passes * (kbytes / 1024.0) / seconds : 0.0,
+               seconds);
+        fflush(stdout);
+    }
+    if (slot) {
+        pushJOBEVENT(slot, JOB_EXIT, 0);
+        cooperateJOBSLOT(slot, FALSE);
+    }
+}
+ 
 /*******************************************************************
   
   void PrintUsage(char * pgmName)
@@ -247,9 +569,12 @@ void PrintUsage(char * pgmName)
     printf("\n"
            "  program: %s - trap and report process control signals\n\n"
            "    usage:\n\n"
-           "      %s [seconds]\n\n"
-           "      where [seconds] is the lifetime of the program - default = 20s.\n\n"
-           "    the program sleeps for a second, reports process id and tick count\n"
+           "      %s [-l load] [-m kbytes] [-f file] [seconds]\n\n"
+           "      where [seconds] is the lifetime of the program - default = 20s.\n"
+           "      [load] is idle (default), cpu, mem, touch or io; [kbytes] is the\n"
+           "      working set of mem, touch and io - default = 65536; [file] is\n"
+           "      where io writes - default = an unlinked temporary file.\n\n"
+           "    the program sleeps (or works) for a second, reports process id and tick count\n"
            "    before sleeping again. any process control signals: SIGINT, SIGQUIT\n"
            "    SIGHUP, SIGTERM, SIGABRT, SIGCONT, SIGTSTP, are trapped and\n"
            "    reported before being actioned.\n\n",
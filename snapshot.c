@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "snapshot.h"
+
+#define MAGIC "DSNAPSHT"
+#define ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct layout_struct {
+    size_t jobs, ints, strings, stats, size; // Offsets, then the total
+} LAYOUT;
+
+static int layout(const SNAPHEADER *h,LAYOUT *l);
+static int writeAll(int fd,struct iovec *iov,int n);
+
+// Function: writeSNAPSHOT
+// Takes in a path and a SNAPSHOT whose header gives the sizes of the rest;
+//     its magic and version are filled in here
+// Writes the snapshot beside the path, syncs it and renames it into place.
+// Returns 0, or -1 with errno set.
+
+int writeSNAPSHOT(const char *path, const SNAPSHOT *s) {
+    SNAPHEADER h = *s->header;
+    memcpy(h.magic, MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    LAYOUT l;
+    if (layout(&h, &l) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t len = strlen(path);
+    char *tmp = (char *)malloc(len + 5);
+    assert(tmp != 0);
+    memcpy(tmp, path, len);
+    strcpy(tmp + len, ".tmp");
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+    static const char zeros[8];
+    struct iovec iov[] = {
+        { &h, sizeof(h) },
+        { (void *)zeros, l.jobs - sizeof(h) },
+        { (void *)s->jobs, l.ints - l.jobs },
+        { (void *)s->ints, l.strings - l.ints },
+        { (void *)s->strings, h.strings_size },
+        { (void *)zeros, l.stats - l.strings - h.strings_size },
+        { (void *)s->stats, h.stats_size },
+    };
+    if (writeAll(fd, iov, sizeof(iov) / sizeof(iov[0])) < 0 || fsync(fd) < 0) {
+        int saved = errno;
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        errno = saved;
+        return -1;
+    }
+    close(fd);
+    int rc = rename(tmp, path);
+    if (rc < 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+    }
+    free(tmp);
+    return rc;
+}
+
+// Function: mapSNAPSHOT
+// Takes in the path of a snapshot
+// Maps it in and checks that its sizes agree with each other and the file.
+// Returns a SNAPSHOT pointing into the mapping, or NULL with errno set,
+//     EINVAL if the file isn't a snapshot this version can read.
+
+SNAPSHOT *mapSNAPSHOT(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return 0;
+    }
+    if ((size_t)st.st_size < sizeof(SNAPHEADER)) {
+        close(fd);
+        errno = EINVAL;
+        return 0;
+    }
+    void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    const SNAPHEADER *h = (const SNAPHEADER *)map;
+    const char *base = (const char *)map;
+    LAYOUT l;
+    int ok = memcmp(h->magic, MAGIC, sizeof(h->magic)) == 0 && h->version == SNAPSHOT_VERSION
+             && layout(h, &l) == 0 && l.size == (size_t)st.st_size
+             && (h->strings_size == 0 || base[l.strings + h->strings_size - 1] == '\0')
+             && memchr(h->policy, '\0', sizeof(h->policy)) != 0;
+    if (!ok) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return 0;
+    }
+    SNAPSHOT *s = (SNAPSHOT *)malloc(sizeof(SNAPSHOT));
+    assert(s != 0);
+    s->header = h;
+    s->jobs = (const SNAPJOB *)(base + l.jobs);
+    s->ints = (const int *)(base + l.ints);
+    s->strings = base + l.strings;
+    s->stats = base + l.stats;
+    s->map = map;
+    s->size = st.st_size;
+    return s;
+}
+
+// Function: unmapSNAPSHOT
+// Takes in a SNAPSHOT from mapSNAPSHOT
+// Unmaps it; nothing read from it may be used after.
+// Returns nothing.
+
+void unmapSNAPSHOT(SNAPSHOT *s) {
+    munmap(s->map, s->size);
+    free(s);
+}
+
+// Static function: layout
+// Takes in a header and a LAYOUT to fill in
+// Works out where each part of the snapshot starts. The records and the
+//     counters start on 8-byte boundaries.
+// Returns 0, or -1 if a size is negative or the queues overrun the ints.
+
+static int layout(const SNAPHEADER *h, LAYOUT *l) {
+    if (h->num_jobs < 0 || h->num_ints < 0 || h->strings_size < 0 || h->stats_size < 0) {
+        return -1;
+    }
+    long long queued = 0;
+    int i;
+    for (i = 0; i < SNAPSHOT_QUEUES; i++) {
+        if (h->queue_sizes[i] < 0) {
+            return -1;
+        }
+        queued += h->queue_sizes[i];
+    }
+    if (queued > h->num_ints) {
+        return -1;
+    }
+    l->jobs = ALIGN(sizeof(SNAPHEADER));
+    l->ints = l->jobs + (size_t)h->num_jobs * sizeof(SNAPJOB);
+    l->strings = l->ints + (size_t)h->num_ints * sizeof(int);
+    l->stats = ALIGN(l->strings + h->strings_size);
+    l->size = l->stats + h->stats_size;
+    return 0;
+}
+
+// Static function: writeAll
+// Takes in a file descriptor and buffers to write to it in order
+// Writes all of them, carrying on after short writes.
+// Returns 0, or -1 with errno set.
+
+static int writeAll(int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t done = writev(fd, iov, n > IOV_MAX ? IOV_MAX : n);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (n > 0 && (size_t)done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/****************************************************************\
+ * FILE: snapshot.h
+ * This is the header file for the snapshot module.
+ * A SNAPSHOT is the dispatcher's state at the top of a tick, laid
+ * out as one file that is mapped straight back in rather than
+ * parsed: a header, a fixed-size record per job in dispatch-list
+ * order, an array of ints and a table of strings. Nothing in it is a
+ * pointer; jobs refer to each other by id, and to their commands by
+ * offset into the strings. The ints hold the run queues, each in its
+ * own order, the jobs held back from them, and then every job's
+ * dependents.
+ *
+ * A snapshot is written to a temporary file beside its path and
+ * renamed into place, so the path always holds a whole one.
+\****************************************************************/
+
+#ifndef __SNAPSHOT_INCLUDED__
+#define __SNAPSHOT_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_QUEUES 13 // Four run queues, four ready heaps, the EDF heap
+// and the four FIFOs of jobs deferred under --queue-limit
+#define SNAPSHOT_NAME 32
+
+typedef struct snapshot_header_struct {
+    char magic[8];
+    int version;
+    int pid; // The dispatcher that wrote it
+    int num_jobs;
+    int curr_time;
+    int num_procs_processed;
+    int running; // Id of the job holding the CPU, or -1
+    int accepting; // Still taking submissions
+    int queue_sizes[SNAPSHOT_QUEUES]; // The queues come first in the ints
+    int num_ints;
+    int strings_size; // Bytes, each string ending in '\0'
+    int stats_size; // Bytes of the dispatcher's counters, after the strings
+    char policy[SNAPSHOT_NAME];
+} SNAPHEADER;
+
+typedef struct snapshot_job_struct {
+    int64_t arrival_us;
+    int64_t start_us;
+    int64_t end_us;
+    int64_t deadline_us;
+    int64_t cpu_us;
+    int64_t resumed_us;
+    unsigned long long pid_start; // When the pid started, in clock ticks
+    // after boot, to tell it from a later process given the same pid
+    double density;
+    int arrival_time;
+    int priority;
+    int proc_time;
+    int service_time;
+    int ticks;
+    int state;
+    int pid;
+    int edf;
+    int critical;
+    int waiting_on;
+    int first_dependent; // Index of its dependents in the ints
+    int num_dependents;
+    int command; // Offset of its command line in the strings, or -1
+    int deadline_pending; // Its deadline hadn't been reached yet
+    int deferred; // Arrived and held back; it is in a deferred FIFO
+    int last_cpu; // The CPU it was last seen on, or -1
+    int home; // The CPU it is pinned to under --affinity, or -1
+} SNAPJOB;
+
+typedef struct snapshot_struct {
+    const SNAPHEADER *header;
+    const SNAPJOB *jobs;
+    const int *ints;
+    const char *strings;
+    const void *stats;
+    void *map; // The mapping, when read back
+    size_t size;
+} SNAPSHOT;
+
+extern int writeSNAPSHOT(const char *path,const SNAPSHOT *s);
+extern SNAPSHOT *mapSNAPSHOT(const char *path);
+extern void unmapSNAPSHOT(SNAPSHOT *s);
+
+#endif
@@ -0,0 +1,530 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sweep.h"
+
+#define TICK_US 1000000 // One TIME_QUANTUM, as in the dispatcher
+#define MAX_VALUES 64 // Values one parameter can be swept over
+
+struct sweep {
+    SWEEPJOB *jobs;
+    int n;
+    int *order; // Job indices by arrival time, then index
+};
+
+typedef struct sim_job_struct {
+    int remaining; // Ticks of service left
+    int level;
+    int next; // Next job in its run queue, or -1
+    int started;
+    int waiting_since; // Tick it joined its run queue
+    int64_t resumed_us;
+} SIMJOB;
+
+typedef struct queue_struct {
+    int head, tail; // -1 when empty
+    int size;
+} QUEUE;
+
+typedef struct run_struct {
+    const SWEEP *s;
+    const SWEEPCONFIG *c;
+    SIMJOB *jobs;
+    QUEUE rq[SWEEP_MAX_LEVELS];
+    int running[SWEEP_MAX_CPUS]; // Job on each CPU, or -1
+    int slice[SWEEP_MAX_CPUS]; // Tick boundaries since it got the CPU
+    int *batch; // Jobs admitted by one check
+    int cursor; // Next job in s->order to arrive
+    int tick;
+    int64_t now_us;
+    int num_system;
+    double turnaround, response, system_latency;
+    SWEEPRESULT *r;
+} RUN;
+
+typedef struct pool_struct {
+    SWEEP *s;
+    const SWEEPCONFIG *configs;
+    SWEEPRESULT *results;
+    int count;
+    atomic_int next; // Next configuration to take
+} POOL;
+
+static int compareOrder(const void *a,const void *b,void *jobs);
+static int compareInts(const void *a,const void *b);
+static int parseValues(const char *list,int *values);
+static void push(RUN *run,int level,int j);
+static int pop(RUN *run,int level);
+static int admit(RUN *run);
+static void age(RUN *run);
+static void finish(RUN *run,int cpu);
+static void switchTo(RUN *run,int cpu,int level);
+static void placeSystem(RUN *run);
+static void placeLevels(RUN *run,int idle_only);
+static void between(RUN *run,int64_t tick_end);
+static void *worker(void *arg);
+
+// Function: newSWEEP
+// Takes in the jobs of a dispatch list, in order, and how many there are
+// Copies them into a table that simulations only ever read.
+// Returns the new SWEEP.
+
+SWEEP *newSWEEP(const SWEEPJOB *jobs, int n) {
+    SWEEP *s = (SWEEP *)malloc(sizeof(SWEEP));
+    assert(s != 0);
+    s->n = n;
+    s->jobs = (SWEEPJOB *)malloc(sizeof(SWEEPJOB) * (n ? n : 1));
+    s->order = (int *)malloc(sizeof(int) * (n ? n : 1));
+    assert(s->jobs != 0 && s->order != 0);
+    memcpy(s->jobs, jobs, sizeof(SWEEPJOB) * n);
+    int i;
+    for (i = 0; i < n; i++) {
+        s->order[i] = i;
+    }
+    qsort_r(s->order, n, sizeof(int), compareOrder, s->jobs);
+    return s;
+}
+
+// Function: parseSWEEP
+// Takes in a sweep spec, e.g. "levels=3:4,quantum=1:2:4,aging=0:8,cpus=1:2",
+//     the preempt bound to simulate with and where to put the configurations
+// Parameters left out keep the dispatcher's values: 4 levels, a quantum of
+//     1, no aging and 1 CPU.
+// Returns the number of configurations, every combination of the values,
+//     in a new array the caller frees; or -1 if the spec is bad.
+
+int parseSWEEP(const char *spec, int preempt_bound_ms, SWEEPCONFIG **configs) {
+    static const char *names[4] = { "levels", "quantum", "aging", "cpus" };
+    static const int min[4] = { 2, 1, 0, 1 };
+    static const int max[4] = { SWEEP_MAX_LEVELS, 1 << 20, 1 << 20, SWEEP_MAX_CPUS };
+    int values[4][MAX_VALUES] = { { 4 }, { 1 }, { 0 }, { 1 } };
+    int counts[4] = { 1, 1, 1, 1 };
+    char *copy = strdup(spec);
+    assert(copy != 0);
+    char *save = 0, *item;
+    int ok = 1;
+    for (item = strtok_r(copy, ",", &save); item && ok; item = strtok_r(0, ",", &save)) {
+        char *eq = strchr(item, '=');
+        int k;
+        for (k = 0; k < 4; k++) {
+            if (eq && strncmp(item, names[k], eq - item) == 0 && names[k][eq - item] == '\0') {
+                break;
+            }
+        }
+        ok = k < 4 && (counts[k] = parseValues(eq + 1, values[k])) > 0;
+        int i;
+        for (i = 0; ok && i < counts[k]; i++) {
+            ok = values[k][i] >= min[k] && values[k][i] <= max[k];
+        }
+    }
+    free(copy);
+    if (!ok) {
+        return -1;
+    }
+    int n = counts[0] * counts[1] * counts[2] * counts[3];
+    *configs = (SWEEPCONFIG *)malloc(sizeof(SWEEPCONFIG) * n);
+    assert(*configs != 0);
+    int i;
+    for (i = 0; i < n; i++) {
+        int rest = i;
+        SWEEPCONFIG *c = &(*configs)[i];
+        c->cpus = values[3][rest % counts[3]];
+        rest /= counts[3];
+        c->aging = values[2][rest % counts[2]];
+        rest /= counts[2];
+        c->quantum = values[1][rest % counts[1]];
+        rest /= counts[1];
+        c->levels = values[0][rest];
+        c->preempt_bound_ms = preempt_bound_ms;
+    }
+    return n;
+}
+
+// Function: simulateSWEEP
+// Takes in a SWEEP, a configuration and where to put the result
+// Runs the jobs to completion on a virtual clock, ticking as the dispatcher
+//     does: admit arrivals, age, end jobs whose time is up, place system jobs
+//     and then the round-robin levels, and charge a tick to every job
+//     holding a CPU. Between ticks, arrivals are checked every
+//     preempt_bound_ms, and system jobs start at once.
+// Returns nothing.
+
+void simulateSWEEP(SWEEP *s, const SWEEPCONFIG *config, SWEEPRESULT *result) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    RUN run;
+    memset(&run, 0, sizeof(run));
+    memset(result, 0, sizeof(*result));
+    run.s = s;
+    run.c = config;
+    run.r = result;
+    run.jobs = (SIMJOB *)malloc(sizeof(SIMJOB) * (s->n ? s->n : 1));
+    run.batch = (int *)malloc(sizeof(int) * (s->n ? s->n : 1));
+    assert(run.jobs != 0 && run.batch != 0);
+    int i;
+    for (i = 0; i < s->n; i++) {
+        SIMJOB *j = &run.jobs[i];
+        j->remaining = s->jobs[i].service;
+        j->level = s->jobs[i].priority < config->levels ? s->jobs[i].priority
+                                                         : config->levels - 1;
+        j->next = -1;
+        j->started = 0;
+        j->resumed_us = -1;
+    }
+    for (i = 0; i < config->levels; i++) {
+        run.rq[i].head = run.rq[i].tail = -1;
+    }
+    for (i = 0; i < config->cpus; i++) {
+        run.running[i] = -1;
+    }
+    for (run.tick = 0;; run.tick++) {
+        run.now_us = (int64_t)run.tick * TICK_US;
+        admit(&run);
+        if (config->aging > 0) {
+            age(&run);
+        }
+        int cpu;
+        for (cpu = 0; cpu < config->cpus; cpu++) {
+            if (run.running[cpu] >= 0) {
+                if (run.jobs[run.running[cpu]].remaining <= 0) {
+                    finish(&run, cpu);
+                } else {
+                    run.slice[cpu]++;
+                }
+            }
+        }
+        placeSystem(&run);
+        placeLevels(&run, 0);
+        int busy = 0;
+        for (cpu = 0; cpu < config->cpus; cpu++) {
+            if (run.running[cpu] >= 0) {
+                run.jobs[run.running[cpu]].remaining--;
+                busy = 1;
+            }
+        }
+        if (!busy && run.cursor == s->n) {
+            break;
+        }
+        between(&run, (int64_t)(run.tick + 1) * TICK_US);
+    }
+    result->makespan_us = run.now_us;
+    if (s->n > 0) {
+        result->turnaround_us = run.turnaround / s->n;
+        result->response_us = run.response / s->n;
+    }
+    if (run.num_system > 0) {
+        result->system_latency_us = run.system_latency / run.num_system;
+    }
+    free(run.jobs);
+    free(run.batch);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    result->cpu_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Function: runSWEEP
+// Takes in a SWEEP, the configurations to simulate and how many, the number
+//     of threads to use and an array for the results, one per configuration
+// Each thread takes the next configuration not yet simulated until none are
+//     left, so a slow one doesn't hold up the rest.
+// Returns nothing.
+
+void runSWEEP(SWEEP *s, const SWEEPCONFIG *configs, int count, int threads,
+              SWEEPRESULT *results) {
+    POOL pool;
+    pool.s = s;
+    pool.configs = configs;
+    pool.results = results;
+    pool.count = count;
+    atomic_init(&pool.next, 0);
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads <= 1) {
+        worker(&pool);
+        return;
+    }
+    pthread_t *ids = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+    assert(ids != 0);
+    int i;
+    for (i = 0; i < threads; i++) {
+        int rc = pthread_create(&ids[i], 0, worker, &pool);
+        assert(rc == 0);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(ids[i], 0);
+    }
+    free(ids);
+}
+
+// Function: freeSWEEP
+// Takes in a SWEEP
+// Frees it and its job table.
+// Returns nothing.
+
+void freeSWEEP(SWEEP *s) {
+    free(s->jobs);
+    free(s->order);
+    free(s);
+}
+
+// Static function: compareOrder
+// qsort_r() comparison of job indices by arrival time, then index.
+
+static int compareOrder(const void *a, const void *b, void *jobs) {
+    int i = *(const int *)a, j = *(const int *)b;
+    const SWEEPJOB *t = (const SWEEPJOB *)jobs;
+    if (t[i].arrival_us != t[j].arrival_us) {
+        return t[i].arrival_us < t[j].arrival_us ? -1 : 1;
+    }
+    return i - j;
+}
+
+// Static function: compareInts
+// qsort() comparison of ints.
+
+static int compareInts(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// Static function: parseValues
+// Takes in a list of values separated by ':' and an array of MAX_VALUES
+// Returns the number of values, or -1 if the list is bad.
+
+static int parseValues(const char *list, int *values) {
+    int n = 0;
+    for (;;) {
+        char *end;
+        long v = strtol(list, &end, 10);
+        if (end == list || n == MAX_VALUES || (*end && *end != ':')) {
+            return -1;
+        }
+        values[n++] = (int)v;
+        if (!*end) {
+            return n;
+        }
+        list = end + 1;
+    }
+}
+
+// Static function: push
+// Takes in a RUN, a level and a job
+// Puts the job at the back of the level's run queue.
+// Returns nothing.
+
+static void push(RUN *run, int level, int j) {
+    QUEUE *q = &run->rq[level];
+    run->jobs[j].level = level;
+    run->jobs[j].next = -1;
+    run->jobs[j].waiting_since = run->tick;
+    if (q->tail >= 0) {
+        run->jobs[q->tail].next = j;
+    } else {
+        q->head = j;
+    }
+    q->tail = j;
+    q->size++;
+}
+
+// Static function: pop
+// Takes in a RUN and a level whose run queue isn't empty
+// Returns the job taken off the front of the queue.
+
+static int pop(RUN *run, int level) {
+    QUEUE *q = &run->rq[level];
+    int j = q->head;
+    q->head = run->jobs[j].next;
+    if (q->head < 0) {
+        q->tail = -1;
+    }
+    q->size--;
+    return j;
+}
+
+// Static function: admit
+// Takes in a RUN
+// Queues every job that has arrived by now, in dispatch-list order.
+// Returns the number of system jobs queued.
+
+static int admit(RUN *run) {
+    const SWEEP *s = run->s;
+    int n = 0;
+    while (run->cursor < s->n && s->jobs[s->order[run->cursor]].arrival_us <= run->now_us) {
+        run->batch[n++] = s->order[run->cursor++];
+    }
+    if (n > 1) {
+        qsort(run->batch, n, sizeof(int), compareInts);
+    }
+    int num_sys = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+        int j = run->batch[i];
+        push(run, run->jobs[j].level, j);
+        num_sys += run->jobs[j].level == 0;
+    }
+    return num_sys;
+}
+
+// Static function: age
+// Takes in a RUN
+// Moves each job that has waited at a round-robin level below the first for
+//     the aging threshold up a level. Queues are in the order jobs joined
+//     them, so only their fronts need looking at.
+// Returns nothing.
+
+static void age(RUN *run) {
+    int level;
+    for (level = 2; level < run->c->levels; level++) {
+        QUEUE *q = &run->rq[level];
+        while (q->size > 0 && run->tick - run->jobs[q->head].waiting_since >= run->c->aging) {
+            push(run, level - 1, pop(run, level));
+            run->r->promotions++;
+        }
+    }
+}
+
+// Static function: finish
+// Takes in a RUN and a CPU whose job has no time left
+// Ends the job and leaves the CPU idle.
+// Returns nothing.
+
+static void finish(RUN *run, int cpu) {
+    int j = run->running[cpu];
+    run->r->busy_us += run->now_us - run->jobs[j].resumed_us;
+    run->turnaround += run->now_us - run->s->jobs[j].arrival_us;
+    run->running[cpu] = -1;
+}
+
+// Static function: switchTo
+// Takes in a RUN, a CPU and a level whose run queue isn't empty
+// Suspends and demotes the job on the CPU, if any, as suspendProcess does,
+//     and gives the CPU to the job at the front of the level.
+// Returns nothing.
+
+static void switchTo(RUN *run, int cpu, int level) {
+    int prev = run->running[cpu];
+    if (prev >= 0) {
+        SIMJOB *p = &run->jobs[prev];
+        run->r->busy_us += run->now_us - p->resumed_us;
+        push(run, p->level < run->c->levels - 1 ? p->level + 1 : p->level, prev);
+        run->r->switches++;
+    }
+    int j = pop(run, level);
+    SIMJOB *next = &run->jobs[j];
+    if (!next->started) {
+        next->started = 1;
+        int64_t latency = run->now_us - run->s->jobs[j].arrival_us;
+        run->response += latency;
+        if (level == 0) {
+            run->num_system++;
+            run->system_latency += latency;
+            if (latency > run->r->max_system_latency_us) {
+                run->r->max_system_latency_us = latency;
+            }
+        }
+    }
+    next->resumed_us = run->now_us;
+    run->running[cpu] = j;
+    run->slice[cpu] = 0;
+}
+
+// Static function: placeSystem
+// Takes in a RUN
+// Starts waiting system jobs on idle CPUs, then in place of the jobs at the
+//     lowest levels. A job preempted with no time left is ended rather than
+//     requeued, as in run_system_process.
+// Returns nothing.
+
+static void placeSystem(RUN *run) {
+    while (run->rq[0].size > 0) {
+        int cpu, best = -1;
+        for (cpu = 0; cpu < run->c->cpus; cpu++) {
+            int j = run->running[cpu];
+            if (j < 0) {
+                best = cpu;
+                break;
+            }
+            if (run->jobs[j].level > 0
+                && (best < 0 || run->jobs[j].level > run->jobs[run->running[best]].level)) {
+                best = cpu;
+            }
+        }
+        if (best < 0) {
+            return;
+        }
+        if (run->running[best] >= 0 && run->jobs[run->running[best]].remaining <= 0) {
+            finish(run, best);
+        }
+        switchTo(run, best, 0);
+    }
+}
+
+// Static function: placeLevels
+// Takes in a RUN and whether to fill idle CPUs only
+// Gives each CPU that isn't running a system job, and whose job has had its
+//     quantum, to the front of the highest non-empty round-robin level.
+// Returns nothing.
+
+static void placeLevels(RUN *run, int idle_only) {
+    int cpu;
+    for (cpu = 0; cpu < run->c->cpus; cpu++) {
+        int j = run->running[cpu];
+        if (j >= 0 && (idle_only || run->jobs[j].level == 0
+                       || run->slice[cpu] < run->c->quantum)) {
+            continue;
+        }
+        int level;
+        for (level = 1; level < run->c->levels && run->rq[level].size == 0; level++) {
+        }
+        if (level == run->c->levels) {
+            return;
+        }
+        switchTo(run, cpu, level);
+    }
+}
+
+// Static function: between
+// Takes in a RUN and when the next tick starts
+// Jumps the clock to each arrival check before then that has something to
+//     admit, as simulate_tick does in the dispatcher.
+// Returns nothing.
+
+static void between(RUN *run, int64_t tick_end) {
+    int64_t bound_us = (int64_t)run->c->preempt_bound_ms * 1000;
+    int64_t next_check = run->now_us + bound_us;
+    const SWEEP *s = run->s;
+    while (bound_us > 0 && run->cursor < s->n) {
+        int64_t arrival = s->jobs[s->order[run->cursor]].arrival_us;
+        if (arrival > next_check) {
+            next_check += (arrival - next_check + bound_us - 1) / bound_us * bound_us;
+        }
+        if (next_check >= tick_end) {
+            break;
+        }
+        run->now_us = next_check;
+        if (admit(run) > 0) {
+            placeSystem(run);
+        }
+        placeLevels(run, 1);
+        next_check = run->now_us + bound_us;
+    }
+    run->now_us = tick_end;
+}
+
+// Static function: worker
+// Takes in a POOL
+// Simulates configurations until there are none left.
+// Returns 0.
+
+static void *worker(void *arg) {
+    POOL *pool = (POOL *)arg;
+    int i;
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+        simulateSWEEP(pool->s, &pool->configs[i], &pool->results[i]);
+    }
+    return 0;
+}
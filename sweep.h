@@ -0,0 +1,59 @@
+/****************************************************************\
+ * FILE: sweep.h
+ * This is the header file for the parameter sweep module.
+ * A SWEEP holds a dispatch list as a read-only job table and
+ * simulates it under many configurations at once, one per task on a
+ * pool of threads. Each simulation is the dispatcher's own policy
+ * with its constants opened up: a system level that runs to
+ * completion and preempts, then round-robin levels with demotion,
+ * generalised to any number of levels, quanta of several ticks,
+ * aging of waiting jobs and several CPUs. With 4 levels, a quantum
+ * of 1, no aging and 1 CPU it is exactly the --simulate schedule.
+\****************************************************************/
+
+#ifndef __SWEEP_INCLUDED__
+#define __SWEEP_INCLUDED__
+
+#include <stdint.h>
+
+#define SWEEP_MAX_LEVELS 16
+#define SWEEP_MAX_CPUS 256
+
+typedef struct sweep_job_struct {
+    int64_t arrival_us;
+    int priority; // 0 for a system job
+    int service; // Ticks of CPU it needs
+} SWEEPJOB;
+
+typedef struct sweep_config_struct {
+    int levels; // System level plus round-robin levels, 2 or more
+    int quantum; // Ticks a job holds a CPU before it can be preempted by
+    // a job at a round-robin level
+    int aging; // Ticks a job waits at a level below the first round-robin
+    // one before moving up a level, or 0 for none
+    int cpus;
+    int preempt_bound_ms; // As the dispatcher's option
+} SWEEPCONFIG;
+
+typedef struct sweep_result_struct {
+    int64_t makespan_us; // Until the last job finished
+    int64_t busy_us; // CPU time given to jobs, over all CPUs
+    double turnaround_us; // Mean arrival to finish
+    double response_us; // Mean arrival to first start
+    double system_latency_us; // Mean arrival to start of system jobs
+    int64_t max_system_latency_us;
+    long long switches; // One job suspended for another
+    long long promotions; // Moves up a level by aging
+    double cpu_ms; // CPU time the simulation itself took
+} SWEEPRESULT;
+
+typedef struct sweep SWEEP;
+
+extern SWEEP *newSWEEP(const SWEEPJOB *jobs,int n);
+extern int parseSWEEP(const char *spec,int preempt_bound_ms,SWEEPCONFIG **configs);
+extern void simulateSWEEP(SWEEP *s,const SWEEPCONFIG *config,SWEEPRESULT *result);
+extern void runSWEEP(SWEEP *s,const SWEEPCONFIG *configs,int count,int threads,
+                     SWEEPRESULT *results);
+extern void freeSWEEP(SWEEP *s);
+
+#endif
@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "tracer.h"
+
+#define ALIGN 8 // Records start on multiples of this
+#define PAD_FLAG 0x80000000u // Marks filler up to the end of the buffer
+#define BATCH 64 // Most records per writev()
+#define CACHE_LINE 64
+
+// Precedes each record. The length is 0 until the record is complete, so
+// the writer knows where to stop; the buffer is zeroed behind it.
+typedef struct header_struct {
+    _Atomic uint32_t len;
+    uint32_t unused; // Keeps the header ALIGN bytes long
+} header;
+
+struct tracer {
+    int fd;
+    int policy;
+    size_t cap;
+    char *buf;
+    pthread_t thread;
+    _Alignas(CACHE_LINE) _Atomic uint64_t tail; // Next byte to reserve; any thread
+    _Alignas(CACHE_LINE) _Atomic uint64_t head; // Next byte to write; writer only
+    _Alignas(CACHE_LINE) _Atomic uint32_t sleeping; // Futex word, set while the
+    // writer waits for records
+    _Atomic uint32_t full; // Futex word, set while a producer waits for space
+    _Atomic int stop;
+    _Atomic long long records, bytes, batches, dropped, stalls;
+    _Atomic size_t max_fill;
+};
+
+static void *writer(void *arg);
+static int flushBatch(TRACER *t);
+static int writeAll(int fd,struct iovec *iov,int n);
+static size_t recordSize(size_t len);
+static void wakeWriter(TRACER *t);
+static void waitForSpace(TRACER *t,uint64_t head);
+
+// Function: newTRACER
+// Takes in the descriptor to write to, the size of the buffer in bytes and
+//     the policy for when it is full: drop the new record, or wait for space.
+// Starts the writer thread, with all signals blocked.
+// Returns the new TRACER, or NULL with errno set if the thread can't start.
+
+TRACER *newTRACER(int fd, size_t capacity, int policy) {
+    TRACER *t = (TRACER *)calloc(1, sizeof(TRACER));
+    assert(t != 0);
+    t->fd = fd;
+    t->policy = policy;
+    t->cap = capacity / ALIGN * ALIGN;
+    t->buf = (char *)calloc(1, t->cap);
+    assert(t->buf != 0);
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    int rc = pthread_create(&t->thread, 0, writer, t);
+    pthread_sigmask(SIG_SETMASK, &saved, 0);
+    if (rc != 0) {
+        free(t->buf);
+        free(t);
+        errno = rc;
+        return 0;
+    }
+    return t;
+}
+
+// Function: writeTRACER
+// Takes in a TRACER and a preformatted record
+// Copies the record into the buffer for the writer thread. Safe to call
+//     from several threads at once; with TRACE_DROP it never waits.
+// Returns 1 if the record was queued, 0 if it was dropped.
+
+int writeTRACER(TRACER *t, const char *data, size_t len) {
+    size_t need = recordSize(len);
+    if (len == 0 || len >= PAD_FLAG || need > t->cap / 2) {
+        atomic_fetch_add(&t->dropped, 1);
+        return len == 0;
+    }
+    uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    uint64_t head;
+    size_t pad;
+    int stalled = 0;
+    for (;;) {
+        head = atomic_load_explicit(&t->head, memory_order_acquire);
+        size_t off = tail % t->cap;
+        // a record never wraps; the end of the buffer is padded instead
+        pad = t->cap - off < need ? t->cap - off : 0;
+        if (tail + pad + need - head > t->cap) {
+            if (t->policy == TRACE_DROP) {
+                atomic_fetch_add(&t->dropped, 1);
+                return 0;
+            }
+            if (!stalled) {
+                atomic_fetch_add(&t->stalls, 1);
+                stalled = 1;
+            }
+            waitForSpace(t, head);
+            tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&t->tail, &tail, tail + pad + need)) {
+            break;
+        }
+    }
+    size_t fill = tail + pad + need - head;
+    size_t max = atomic_load_explicit(&t->max_fill, memory_order_relaxed);
+    while (fill > max && !atomic_compare_exchange_weak(&t->max_fill, &max, fill)) {
+    }
+    if (pad) {
+        header *h = (header *)(t->buf + tail % t->cap);
+        atomic_store(&h->len, PAD_FLAG | pad);
+        tail += pad;
+    }
+    header *h = (header *)(t->buf + tail % t->cap);
+    memcpy(h + 1, data, len);
+    atomic_store(&h->len, len);
+    // pairs with the writer setting sleeping before its last look for work
+    if (atomic_load(&t->sleeping)) {
+        wakeWriter(t);
+    }
+    return 1;
+}
+
+// Function: statsTRACER
+// Takes in a TRACER and somewhere to put its counters
+// Copies the counters so far into s.
+
+void statsTRACER(TRACER *t, TRACERSTATS *s) {
+    s->records = atomic_load(&t->records);
+    s->bytes = atomic_load(&t->bytes);
+    s->batches = atomic_load(&t->batches);
+    s->dropped = atomic_load(&t->dropped);
+    s->stalls = atomic_load(&t->stalls);
+    s->max_fill = atomic_load(&t->max_fill);
+    s->capacity = t->cap;
+}
+
+// Function: freeTRACER
+// Takes in a TRACER no thread is writing to any more, and somewhere to put
+//     its final counters, or NULL
+// Waits for the writer thread to write out every record, then frees the
+//     TRACER. The descriptor is left open.
+
+void freeTRACER(TRACER *t, TRACERSTATS *s) {
+    atomic_store(&t->stop, 1);
+    wakeWriter(t);
+    pthread_join(t->thread, 0);
+    if (s) {
+        statsTRACER(t, s);
+    }
+    free(t->buf);
+    free(t);
+}
+
+// Static function: writer
+// Takes in the TRACER
+// The writer thread: writes batches while there are records, and sleeps on
+//     the futex while there are none.
+
+static void *writer(void *arg) {
+    TRACER *t = (TRACER *)arg;
+    for (;;) {
+        if (flushBatch(t)) {
+            continue;
+        }
+        if (atomic_load(&t->stop)) {
+            break;
+        }
+        atomic_store(&t->sleeping, 1);
+        header *h = (header *)(t->buf + atomic_load(&t->head) % t->cap);
+        if (atomic_load(&h->len) != 0 || atomic_load(&t->stop)) {
+            atomic_store(&t->sleeping, 0);
+            continue;
+        }
+        syscall(SYS_futex, (uint32_t *)&t->sleeping, FUTEX_WAIT_PRIVATE, 1, 0, 0, 0);
+    }
+    return 0;
+}
+
+// Static function: flushBatch
+// Takes in a TRACER
+// Writes up to BATCH complete records from the head of the buffer with one
+//     writev(), then zeroes their space and hands it back to producers.
+// Returns 1 if any space was freed, 0 if there was nothing to write.
+
+static int flushBatch(TRACER *t) {
+    struct iovec iov[BATCH];
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    uint64_t pos = head;
+    int n = 0;
+    size_t bytes = 0;
+    while (n < BATCH) {
+        header *h = (header *)(t->buf + pos % t->cap);
+        uint32_t len = atomic_load(&h->len);
+        if (len == 0) {
+            break;
+        }
+        if (len & PAD_FLAG) {
+            pos += len & ~PAD_FLAG;
+            continue;
+        }
+        iov[n].iov_base = h + 1;
+        iov[n].iov_len = len;
+        n++;
+        bytes += len;
+        pos += recordSize(len);
+    }
+    if (pos == head) {
+        return 0;
+    }
+    if (n > 0 && writeAll(t->fd, iov, n) < 0) {
+        atomic_fetch_add(&t->dropped, n);
+    } else if (n > 0) {
+        atomic_fetch_add(&t->records, n);
+        atomic_fetch_add(&t->bytes, bytes);
+        atomic_fetch_add(&t->batches, 1);
+    }
+    // records are placed at varying offsets, so old payloads must not be
+    // mistaken for headers
+    size_t from = head % t->cap, len = pos - head;
+    if (from + len > t->cap) {
+        memset(t->buf + from, 0, t->cap - from);
+        memset(t->buf, 0, from + len - t->cap);
+    } else {
+        memset(t->buf + from, 0, len);
+    }
+    // sequentially consistent, to pair with a producer setting full before
+    // its last look at the head
+    atomic_store(&t->head, pos);
+    if (atomic_exchange(&t->full, 0)) {
+        syscall(SYS_futex, (uint32_t *)&t->full, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+    }
+    return 1;
+}
+
+// Static function: writeAll
+// Takes in a descriptor and an array of n buffers
+// Writes all of them, carrying on after partial writes.
+// Returns 0, or -1 with errno set if a write failed.
+
+static int writeAll(int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w < 0) {
+            return -1;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+// Static function: recordSize
+// Takes in the length of a record
+// Returns the space it takes in the buffer, header included.
+
+static size_t recordSize(size_t len) {
+    return (sizeof(header) + len + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+// Static function: wakeWriter
+// Takes in a TRACER
+// Wakes the writer thread if it is waiting for records.
+
+static void wakeWriter(TRACER *t) {
+    atomic_store(&t->sleeping, 0);
+    syscall(SYS_futex, (uint32_t *)&t->sleeping, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+}
+
+// Static function: waitForSpace
+// Takes in a TRACER and the head a producer found it full at
+// Wakes the writer thread, and sleeps on the futex until it has freed some
+//     space. Sleeping rather than yielding lets the writer run even when the
+//     producer has a real-time policy and the writer hasn't.
+
+static void waitForSpace(TRACER *t, uint64_t head) {
+    wakeWriter(t);
+    atomic_store(&t->full, 1);
+    if (atomic_load(&t->head) != head) {
+        return;
+    }
+    syscall(SYS_futex, (uint32_t *)&t->full, FUTEX_WAIT_PRIVATE, 1, 0, 0, 0);
+}
@@ -0,0 +1,37 @@
+/****************************************************************\
+ * FILE: tracer.h
+ * This is the header file for the asynchronous trace writer module.
+ * A TRACER owns a writer thread and a lock-free buffer of
+ * preformatted records. Any thread can add a record without
+ * blocking; the writer thread collects records in batches and writes
+ * each batch with a single writev(), so a slow terminal or disk never
+ * holds up the threads producing them.
+\****************************************************************/
+
+#ifndef __TRACER_INCLUDED__
+#define __TRACER_INCLUDED__
+
+#include <stddef.h>
+
+// What writeTRACER does when the buffer is full
+enum trace_policy { TRACE_DROP, TRACE_BLOCK };
+
+typedef struct tracer_stats_struct {
+    long long records; // Records written out
+    long long bytes;
+    long long batches; // writev() calls
+    long long dropped; // Records dropped because the buffer was full,
+    // too big for it, or couldn't be written
+    long long stalls; // Times a producer had to wait for space
+    size_t max_fill; // Most bytes ever held in the buffer
+    size_t capacity;
+} TRACERSTATS;
+
+typedef struct tracer TRACER;
+
+extern TRACER *newTRACER(int fd,size_t capacity,int policy);
+extern int writeTRACER(TRACER *t,const char *data,size_t len);
+extern void statsTRACER(TRACER *t,TRACERSTATS *s);
+extern void freeTRACER(TRACER *t,TRACERSTATS *s);
+
+#endif
@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdlib.h>
+#include "wheel.h"
+
+#define BITS 6
+#define SLOTS (1 << BITS)
+#define LEVELS 11 // Enough digits for any time an int64_t can hold
+#define DUE (LEVELS * SLOTS) // The slot of timers added at or before now
+
+struct wheel {
+    int64_t now; // Every timer due by now has been expired
+    uint64_t occupied[LEVELS]; // A bit per slot with timers in it
+    TIMER slots[LEVELS * SLOTS + 1]; // List heads, DUE last
+    int count;
+};
+
+static void place(WHEEL *w,TIMER *t);
+static void append(TIMER *head,TIMER *t);
+static int64_t slotStart(WHEEL *w,int level,int slot);
+
+// Function: newWHEEL
+// Takes in the time to start at
+// Returns a new, empty WHEEL.
+
+WHEEL *newWHEEL(int64_t now) {
+    WHEEL *w = (WHEEL *)malloc(sizeof(WHEEL));
+    assert(w != 0);
+    w->now = now;
+    w->count = 0;
+    int i;
+    for (i = 0; i < LEVELS; i++) {
+        w->occupied[i] = 0;
+    }
+    for (i = 0; i <= DUE; i++) {
+        w->slots[i].next = w->slots[i].prev = &w->slots[i];
+    }
+    return w;
+}
+
+// Function: initTIMER
+// Takes in a TIMER and what it times
+// Sets it up, not pending, to be added to a WHEEL.
+// Returns nothing.
+
+void initTIMER(TIMER *t, void *data) {
+    t->next = t->prev = 0;
+    t->slot = -1;
+    t->data = data;
+}
+
+// Function: addWHEEL
+// Takes in a WHEEL, a TIMER that isn't pending and when it is due
+// Adds the timer in O(1). One due at or before the wheel's time is
+//     expired by the next expireWHEEL.
+// Returns nothing.
+
+void addWHEEL(WHEEL *w, TIMER *t, int64_t when) {
+    assert(t->slot < 0);
+    t->when = when;
+    place(w, t);
+    w->count++;
+}
+
+// Function: cancelWHEEL
+// Takes in a WHEEL and one of its TIMERs, pending or not
+// Takes the timer out in O(1) if it is pending.
+// Returns nothing.
+
+void cancelWHEEL(WHEEL *w, TIMER *t) {
+    if (t->slot < 0) {
+        return;
+    }
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    TIMER *head = &w->slots[t->slot];
+    if (head->next == head && t->slot != DUE) {
+        w->occupied[t->slot / SLOTS] &= ~((uint64_t)1 << (t->slot % SLOTS));
+    }
+    t->slot = -1;
+    w->count--;
+}
+
+// Function: pendingTIMER
+// Takes in a TIMER
+// Returns 1 if it is in a wheel and hasn't expired, 0 if not.
+
+int pendingTIMER(TIMER *t) {
+    return t->slot >= 0;
+}
+
+// Function: expireWHEEL
+// Takes in a WHEEL and a time, which is no earlier than the last one
+// Moves the wheel's time on to it, jumping from one occupied slot to the
+//     next, and takes out every timer due by then. A slot of a higher
+//     wheel that is reached is spread over the lower ones.
+// Returns the timers expired, linked through next in the order they fell
+//     due, or NULL if there were none. None is pending any more.
+
+TIMER *expireWHEEL(WHEEL *w, int64_t to) {
+    TIMER *first = 0, **tail = &first;
+    TIMER *head = &w->slots[DUE];
+    TIMER *t, *next;
+    for (t = head->next; t != head; t = next) {
+        next = t->next;
+        t->slot = -1;
+        w->count--;
+        *tail = t;
+        tail = &t->next;
+    }
+    head->next = head->prev = head;
+    while (to >= w->now) {
+        // a timer in a higher wheel is later than any in a lower one
+        int level = 0;
+        while (level < LEVELS && !w->occupied[level]) {
+            level++;
+        }
+        if (level == LEVELS) {
+            break;
+        }
+        int slot = __builtin_ctzll(w->occupied[level]);
+        int64_t start = slotStart(w, level, slot);
+        if (start > to) {
+            break;
+        }
+        w->now = start;
+        w->occupied[level] &= ~((uint64_t)1 << slot);
+        head = &w->slots[level * SLOTS + slot];
+        t = head->next;
+        head->next = head->prev = head;
+        for (; t != head; t = next) {
+            next = t->next;
+            if (t->when <= w->now) {
+                t->slot = -1;
+                w->count--;
+                *tail = t;
+                tail = &t->next;
+            } else {
+                place(w, t);
+            }
+        }
+    }
+    *tail = 0;
+    if (to > w->now) {
+        w->now = to;
+    }
+    return first;
+}
+
+// Function: nextWHEEL
+// Takes in a WHEEL
+// Returns a time no timer is due before, exact unless the earliest timers
+//     are still in a higher wheel, or -1 if the wheel is empty.
+
+int64_t nextWHEEL(WHEEL *w) {
+    if (w->slots[DUE].next != &w->slots[DUE]) {
+        return w->now;
+    }
+    int level;
+    for (level = 0; level < LEVELS; level++) {
+        if (w->occupied[level]) {
+            return slotStart(w, level, __builtin_ctzll(w->occupied[level]));
+        }
+    }
+    return -1;
+}
+
+// Function: sizeWHEEL
+// Takes in a WHEEL
+// Returns the number of pending timers in it.
+
+int sizeWHEEL(WHEEL *w) {
+    return w->count;
+}
+
+// Function: freeWHEEL
+// Takes in a WHEEL
+// Frees it; its timers are left as they are.
+// Returns nothing.
+
+void freeWHEEL(WHEEL *w) {
+    free(w);
+}
+
+// Static function: place
+// Takes in a WHEEL and a TIMER not in it
+// Puts the timer in the slot of the lowest wheel that holds its time, the
+//     wheel of the highest digit where its time and the wheel's differ.
+// Returns nothing.
+
+static void place(WHEEL *w, TIMER *t) {
+    if (t->when <= w->now) {
+        t->slot = DUE;
+        append(&w->slots[DUE], t);
+        return;
+    }
+    int level = (63 - __builtin_clzll((uint64_t)(t->when ^ w->now))) / BITS;
+    int slot = (t->when >> (level * BITS)) & (SLOTS - 1);
+    t->slot = level * SLOTS + slot;
+    append(&w->slots[t->slot], t);
+    w->occupied[level] |= (uint64_t)1 << slot;
+}
+
+// Static function: append
+// Takes in the head of a slot's list and a TIMER
+// Adds the timer at the end of the list.
+// Returns nothing.
+
+static void append(TIMER *head, TIMER *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+// Static function: slotStart
+// Takes in a WHEEL and a slot of one of its wheels
+// Returns the time the slot starts at: the wheel's time with the digit of
+//     that wheel replaced by the slot and every lower digit 0.
+
+static int64_t slotStart(WHEEL *w, int level, int slot) {
+    int shift = (level + 1) * BITS;
+    int64_t high = shift < 63 ? w->now >> shift << shift : 0;
+    return high | ((int64_t)slot << (level * BITS));
+}
@@ -0,0 +1,41 @@
+/****************************************************************\
+ * FILE: wheel.h
+ * This is the header file for the timing wheel module.
+ * A WHEEL holds TIMERs, each due at a time in microseconds, in a
+ * hierarchy of wheels of 64 slots: a slot of the first is one
+ * microsecond, of the next 64, and so on. A timer goes in the first
+ * wheel its time and the wheel's own time share all higher digits
+ * of, and moves down a wheel at a time as the time nears, so adding
+ * and cancelling a timer is O(1) and expiring one is O(1) amortised.
+ * A bitmap of the occupied slots of each wheel lets the time jump
+ * straight past empty ones, however far apart the timers are.
+ *
+ * TIMERs are embedded in whatever they time; a WHEEL never
+ * allocates one.
+\****************************************************************/
+
+#ifndef __WHEEL_INCLUDED__
+#define __WHEEL_INCLUDED__
+
+#include <stdint.h>
+
+typedef struct timer_struct {
+    struct timer_struct *next, *prev;
+    int64_t when;
+    int slot; // Where it is in the wheel, or -1 if it isn't pending
+    void *data;
+} TIMER;
+
+typedef struct wheel WHEEL;
+
+extern WHEEL *newWHEEL(int64_t now);
+extern void initTIMER(TIMER *t,void *data);
+extern void addWHEEL(WHEEL *w,TIMER *t,int64_t when);
+extern void cancelWHEEL(WHEEL *w,TIMER *t);
+extern int pendingTIMER(TIMER *t);
+extern TIMER *expireWHEEL(WHEEL *w,int64_t to);
+extern int64_t nextWHEEL(WHEEL *w);
+extern int sizeWHEEL(WHEEL *w);
+extern void freeWHEEL(WHEEL *w);
+
+#endif